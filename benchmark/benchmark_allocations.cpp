@@ -0,0 +1,147 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Counts the heap allocations per image of handing a datum from a reader to
+// a writer: filling the datum and its key, passing them through a queue and
+// keeping them in the batch until the commit. "allocating" makes a new datum
+// and key for every image, "pooled" recycles them through a RecordPool. The
+// decoder and the database are left out.
+//
+// Usage: benchmark_allocations [width height [images]]
+
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <new>
+#include <stdlib.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "blocking_queue.hpp"
+#include "hwc_to_chw.hpp"
+#include "metadata.hpp"
+#include "record_pool.hpp"
+
+static std::atomic<size_t> nr_of_allocations(0);
+
+void* operator new(size_t size) {
+    nr_of_allocations ++;
+    void* p = malloc(size ? size : 1);
+    if (! p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const size_t queue_capacity = 16;
+static const size_t batch_size = 64;
+static const std::string image_path = "n01440764/n01440764_10026.JPEG";
+
+/* The reader to writer hand-off with a new datum and key per image. */
+static void allocating(const cv::Mat& cv_img, size_t first, size_t images) {
+    typedef std::pair<std::string, shared_ptr<caffe::Datum> > KeyDatum;
+    BlockingQueue<KeyDatum> queue(queue_capacity, SIZE_MAX);
+    std::vector<KeyDatum> batch;
+
+    for (size_t line = first; line < first + images; ++line) {
+        shared_ptr<caffe::Datum> datum(new caffe::Datum());
+        mat_to_datum(cv_img, datum.get());
+        std::string key = record_key(line, image_path);
+        queue.Push(std::make_pair(std::move(key), datum), datum->ByteSizeLong());
+
+        KeyDatum value;
+        queue.Pop(value);
+        batch.push_back(value);
+        if (batch.size() == batch_size) {
+            batch.clear();
+        }
+    }
+}
+
+/* The same with records from a pool. */
+static void pooled(RecordPool* pool, const cv::Mat& cv_img, size_t first, size_t images) {
+    BlockingQueue<shared_ptr<Record> > queue(queue_capacity, SIZE_MAX);
+    std::vector<shared_ptr<Record> > batch;
+
+    batch.reserve(batch_size);
+    for (size_t line = first; line < first + images; ++line) {
+        shared_ptr<Record> record = pool->Get();
+        mat_to_datum(cv_img, &record->datum);
+        record_key(line, image_path, &record->key);
+        size_t bytes = record->datum.ByteSizeLong();
+        queue.Push(std::move(record), bytes);
+
+        queue.Pop(record);
+        batch.push_back(std::move(record));
+        if (batch.size() == batch_size) {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                pool->Put(std::move(batch[i]));
+            }
+            batch.clear();
+        }
+    }
+    for (size_t i = 0; i < batch.size(); ++i) {
+        pool->Put(std::move(batch[i]));
+    }
+}
+
+template <typename F>
+static void report(const std::string& name, size_t images, F run) {
+    run(0, 1000);  // warm up
+    size_t before = nr_of_allocations;
+    run(1000, images);
+    double per_image = (double)(nr_of_allocations - before) / images;
+
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << per_image
+              << " allocations/image" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 2 ? atoi(argv[1]) : 256;
+    int height = argc > 2 ? atoi(argv[2]) : 256;
+    size_t images = argc > 3 ? atoi(argv[3]) : 10000;
+
+    cv::Mat cv_img(height, width, CV_8UC3);
+    for (int h = 0; h < height; ++h) {
+        uchar* row = cv_img.ptr<uchar>(h);
+        for (int i = 0; i < width * 3; ++i) {
+            row[i] = (uchar)(h * 31 + i);
+        }
+    }
+
+    std::cout << width << "x" << height << " BGR, " << images << " images" << std::endl;
+
+    report("allocating", images, [&](size_t first, size_t count) {
+        allocating(cv_img, first, count);
+    });
+    RecordPool pool;
+    report("pooled", images, [&](size_t first, size_t count) {
+        pooled(&pool, cv_img, first, count);
+    });
+    std::cout << "pooled records  " << std::setw(10) << pool.NrOfAllocations() << std::endl;
+    return 0;
+}
@@ -0,0 +1,90 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the pixels/sec of caffe::CVMatToDatum with the hwc_to_chw kernel
+// at each instruction set the CPU supports.
+//
+// Usage: benchmark_hwc_to_chw [width height [iterations]]
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <stdlib.h>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#define CPU_ONLY
+#ifndef USE_OPENCV
+#define USE_OPENCV
+#endif
+#include "caffe/util/io.hpp"
+
+#include "hwc_to_chw.hpp"
+
+static const char* level_name(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSSE3: return "ssse3";
+        default: return "scalar";
+    }
+}
+
+template <typename F>
+static void report(const std::string& name, int width, int height, int iterations, F convert) {
+    convert();  // warm up
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        convert();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double pixels = (double)width * height * iterations;
+
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << pixels / elapsed.count() / 1e6
+              << " Mpixels/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 2 ? atoi(argv[1]) : 256;
+    int height = argc > 2 ? atoi(argv[2]) : 256;
+    int iterations = argc > 3 ? atoi(argv[3]) : 2000;
+
+    cv::Mat cv_img(height, width, CV_8UC3);
+    for (int h = 0; h < height; ++h) {
+        uchar* row = cv_img.ptr<uchar>(h);
+        for (int i = 0; i < width * 3; ++i) {
+            row[i] = (uchar)(h * 31 + i);
+        }
+    }
+
+    std::cout << width << "x" << height << " BGR, " << iterations << " iterations" << std::endl;
+
+    caffe::Datum datum;
+    report("CVMatToDatum", width, height, iterations, [&] {
+        caffe::CVMatToDatum(cv_img, &datum);
+    });
+    for (int level = SIMD_NONE; level <= detected_simd_level(); ++level) {
+        std::vector<uint8_t> dst((size_t)width * height * 3);
+        report(level_name((SimdLevel)level), width, height, iterations, [&] {
+            hwc_to_chw(cv_img.ptr<uint8_t>(0), cv_img.step, height, width, 3, &dst[0],
+                       (SimdLevel)level);
+        });
+    }
+    report("mat_to_datum", width, height, iterations, [&] {
+        mat_to_datum(cv_img, &datum);
+    });
+    return 0;
+}
@@ -0,0 +1,291 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the import on a synthetic set of images: first each stage on its
+// own in one thread (reading the files, decoding them into datums,
+// serializing, LMDBTransaction::PutDatum and Commit), then the whole import
+// with load_images_in_lmdb. The images are generated in --work_dir, the
+// results are written as JSON.
+//
+// Usage: benchmark_import [--images=N] [--width=W --height=H] [--format=jpg]
+//                         [--output=results.json]
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "image_loader.hpp"
+#include "lmdb.hpp"
+#include "read_ahead.hpp"
+
+#ifndef IMPORTER_PATH
+#define IMPORTER_PATH ""
+#endif
+
+DEFINE_int32(images, 1000, "Number of images to generate");
+DEFINE_int32(width, 500, "Width of the generated images");
+DEFINE_int32(height, 375, "Height of the generated images");
+DEFINE_string(format, "jpg", "Image format of the generated images, e.g. jpg or png");
+DEFINE_int32(resize_width, 256, "Width the images are resized to, 0 to keep the size");
+DEFINE_int32(resize_height, 256, "Height the images are resized to, 0 to keep the size");
+DEFINE_int32(commit_images, 1000, "Number of records per commit in the stage benchmark");
+DEFINE_string(work_dir, "benchmark_work",
+              "Folder for the images and databases. What an earlier run left in it is "
+              "removed first, other files are kept");
+DEFINE_string(importer, IMPORTER_PATH,
+              "Path of load_images_in_lmdb for the end-to-end run, empty to skip it");
+DEFINE_string(importer_flags, "", "Extra flags for the end-to-end run");
+DEFINE_string(output, "", "Write the JSON results to this file instead of stdout");
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* Time and bytes spent in one stage of the import. */
+struct Stage {
+    Stage(const std::string& name) : name(name), seconds(0), bytes(0) { }
+
+    std::string name;
+    double seconds;
+    size_t bytes;
+};
+
+/* Generate the images and their label file. The images are a gradient with
+   noise, so they compress like photos rather than like a flat color. */
+static size_t generate_images(const std::string& folder, const std::string& label_file) {
+    boost::filesystem::create_directories(folder);
+
+    cv::Mat image(FLAGS_height, FLAGS_width, CV_8UC3);
+    std::ofstream labels(label_file.c_str());
+    std::vector<unsigned char> encoded;
+    size_t bytes = 0;
+    unsigned int seed = 1;
+
+    for (int i = 0; i < FLAGS_images; ++i) {
+        for (int h = 0; h < image.rows; ++h) {
+            uchar* row = image.ptr<uchar>(h);
+            for (int w = 0; w < image.cols * 3; ++w) {
+                seed = seed * 1103515245 + 12345;
+                row[w] = (uchar)((h + w / 3 + i * 7) / 2 + (seed >> 27));
+            }
+        }
+        CHECK(cv::imencode("." + FLAGS_format, image, encoded)) << "Can't encode " << FLAGS_format;
+
+        std::ostringstream name;
+        name << "image_" << i << "." << FLAGS_format;
+        std::ofstream file((folder + "/" + name.str()).c_str(), std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&encoded[0]), encoded.size());
+        labels << name.str() << " " << i % 1000 << "\n";
+        bytes += encoded.size();
+    }
+    return bytes;
+}
+
+/* Run each stage of the import in turn for every image, timing them
+   separately. */
+static std::vector<Stage> benchmark_stages(const std::string& folder, const std::string& db_path) {
+    std::vector<Stage> stages;
+    stages.push_back(Stage("read"));
+    stages.push_back(Stage("decode"));
+    stages.push_back(Stage("serialize"));
+    stages.push_back(Stage("put"));
+    stages.push_back(Stage("commit"));
+    Stage& read = stages[0];
+    Stage& decode = stages[1];
+    Stage& serialize = stages[2];
+    Stage& put = stages[3];
+    Stage& commit = stages[4];
+
+    ImageOptions options;
+    options.resize_width = FLAGS_resize_width;
+    options.resize_height = FLAGS_resize_height;
+
+    // Make the map large enough up front, growing it isn't part of the benchmark.
+    bool resize = options.resize_width > 0 && options.resize_height > 0;
+    size_t datum_size = resize ? (size_t)options.resize_width * options.resize_height * 3
+                               : (size_t)FLAGS_width * FLAGS_height * 3;
+    LMDB::Options db_options;
+    db_options.map_size = (datum_size + 4096) * FLAGS_images * 2 + (64 << 20);
+    LMDB db;
+    db.Open(db_path, LMDB::NEW, db_options);
+    boost::scoped_ptr<LMDBTransaction> txn(db.NewTransaction(true));
+
+    std::vector<unsigned char> buffer;
+    std::string serialized;
+    caffe::Datum datum;
+    size_t uncommitted_bytes = 0;
+    for (int i = 0; i < FLAGS_images; ++i) {
+        std::ostringstream path;
+        path << folder << "/image_" << i << "." << FLAGS_format;
+        std::ostringstream key;
+        key << std::setw(8) << std::setfill('0') << i << "_image_" << i << "." << FLAGS_format;
+
+        Clock::time_point start = Clock::now();
+        CHECK(read_file(path.str(), &buffer)) << "Can't read " << path.str();
+        read.seconds += seconds_since(start);
+        read.bytes += buffer.size();
+
+        start = Clock::now();
+        CHECK(load_image(path.str(), buffer, i, options, &datum));
+        decode.seconds += seconds_since(start);
+        decode.bytes += buffer.size();
+
+        // The importer serializes straight into the database, this is what
+        // serializing costs on its own.
+        start = Clock::now();
+        datum.SerializeToString(&serialized);
+        serialize.seconds += seconds_since(start);
+        serialize.bytes += serialized.size();
+
+        start = Clock::now();
+        CHECK(txn->PutDatum(key.str(), datum)) << "Error storing " << key.str();
+        put.seconds += seconds_since(start);
+        put.bytes += serialized.size();
+        uncommitted_bytes += serialized.size();
+
+        if ((i + 1) % FLAGS_commit_images == 0 || i + 1 == FLAGS_images) {
+            start = Clock::now();
+            CHECK(txn->Commit()) << "Error committing";
+            commit.seconds += seconds_since(start);
+            commit.bytes += uncommitted_bytes;
+            uncommitted_bytes = 0;
+            txn.reset(db.NewTransaction(true));
+        }
+    }
+    return stages;
+}
+
+/* Import the images with load_images_in_lmdb. Returns the time it took, or
+   a negative number if it failed. */
+static double benchmark_importer(const std::string& folder, const std::string& label_file,
+                                 const std::string& db_path) {
+    std::ostringstream command;
+
+    command << FLAGS_importer << " --resize_width=" << FLAGS_resize_width
+            << " --resize_height=" << FLAGS_resize_height << " " << FLAGS_importer_flags
+            << " " << folder << "/ " << label_file << " " << db_path << " 2> "
+            << FLAGS_work_dir << "/importer.log";
+    Clock::time_point start = Clock::now();
+    if (std::system(command.str().c_str()) != 0) {
+        LOG(ERROR) << "The import failed, see " << FLAGS_work_dir << "/importer.log";
+        return -1;
+    }
+    return seconds_since(start);
+}
+
+static void write_rates(std::ostream& out, double seconds, size_t bytes) {
+    out << "\"seconds\": " << seconds
+        << ", \"images_per_second\": " << (seconds > 0 ? FLAGS_images / seconds : 0)
+        << ", \"megabytes_per_second\": " << (seconds > 0 ? bytes / seconds / (1 << 20) : 0);
+}
+
+static void write_results(std::ostream& out, size_t corpus_bytes,
+                          const std::vector<Stage>& stages, double import_seconds) {
+    out << "{\n";
+    out << "  \"corpus\": {\"images\": " << FLAGS_images << ", \"width\": " << FLAGS_width
+        << ", \"height\": " << FLAGS_height << ", \"format\": \"" << FLAGS_format
+        << "\", \"bytes\": " << corpus_bytes << "},\n";
+    out << "  \"resize\": {\"width\": " << FLAGS_resize_width << ", \"height\": "
+        << FLAGS_resize_height << "},\n";
+    out << "  \"stages\": {\n";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        out << "    \"" << stages[i].name << "\": {";
+        write_rates(out, stages[i].seconds, stages[i].bytes);
+        out << (i + 1 < stages.size() ? "},\n" : "}\n");
+    }
+    out << "  }";
+    if (import_seconds >= 0) {
+        out << ",\n  \"end_to_end\": {";
+        write_rates(out, import_seconds, corpus_bytes);
+        out << "}";
+    }
+    out << "\n}\n";
+}
+
+/* Remove what an earlier run created in work_dir, and nothing else: the
+   images, the label file, the databases and the log of the importer. The
+   importer may have created more files next to its database, like a
+   manifest or a mean image, all starting with import_db. */
+void remove_earlier_run(const std::string& work_dir) {
+    namespace fs = boost::filesystem;
+
+    if (! fs::is_directory(work_dir)) {
+        return;
+    }
+    fs::remove_all(fs::path(work_dir) / "images");
+    fs::remove_all(fs::path(work_dir) / "stages_db");
+    fs::remove(fs::path(work_dir) / "labels.txt");
+    fs::remove(fs::path(work_dir) / "importer.log");
+    std::vector<fs::path> import_files;
+    for (fs::directory_iterator it(work_dir); it != fs::directory_iterator(); ++it) {
+        if (it->path().filename().string().compare(0, 9, "import_db") == 0) {
+            import_files.push_back(it->path());
+        }
+    }
+    for (size_t i = 0; i < import_files.size(); ++i) {
+        fs::remove_all(import_files[i]);
+    }
+}
+
+int main(int argc, char** argv) {
+#ifndef GFLAGS_GFLAGS_H_
+    namespace gflags = google;
+#endif
+    gflags::SetUsageMessage("Benchmark the import of a synthetic set of images.\n"
+                            "Usage: benchmark_import [FLAGS]");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+
+    CHECK_GT(FLAGS_images, 0);
+    CHECK_GT(FLAGS_commit_images, 0);
+    remove_earlier_run(FLAGS_work_dir);
+    std::string folder = FLAGS_work_dir + "/images";
+    std::string label_file = FLAGS_work_dir + "/labels.txt";
+
+    LOG(INFO) << "Generating " << FLAGS_images << " " << FLAGS_width << "x" << FLAGS_height
+              << " " << FLAGS_format << " images in " << folder << ".";
+    size_t corpus_bytes = generate_images(folder, label_file);
+
+    std::vector<Stage> stages = benchmark_stages(folder, FLAGS_work_dir + "/stages_db");
+
+    double import_seconds = -1;
+    if (! FLAGS_importer.empty()) {
+        import_seconds = benchmark_importer(folder, label_file, FLAGS_work_dir + "/import_db");
+    }
+
+    if (FLAGS_output.empty()) {
+        write_results(std::cout, corpus_bytes, stages, import_seconds);
+    } else {
+        std::ofstream out(FLAGS_output.c_str());
+        write_results(out, corpus_bytes, stages, import_seconds);
+    }
+    return import_seconds < 0 && ! FLAGS_importer.empty() ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "batch_reader.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <boost/scoped_ptr.hpp>
+
+#include "glog/logging.h"
+
+using boost::scoped_ptr;
+
+BatchReader::BatchReader(LMDB* db, size_t batch_size, BatchReader::Order order,
+                         bool float_output, unsigned int seed) :
+    db_(db), batch_size_(batch_size), order_(order), float_output_(float_output),
+    seed_(seed), permutation_epoch_(SIZE_MAX), current_(0), started_(false),
+    stop_(false), records_read_(0) {
+
+    // Collect all keys, so records can be visited in any order.
+    {
+        scoped_ptr<LMDBReadTransaction> txn(db_->NewReadTransaction());
+        if (! txn) {
+            throw std::runtime_error("Failure starting read transaction");
+        }
+        scoped_ptr<LMDBCursor> cursor(txn->NewCursor());
+        for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+            keys_.push_back(cursor->Key().to_string());
+        }
+        if (keys_.empty() || batch_size_ == 0) {
+            throw std::runtime_error("No records to read");
+        }
+        // Batches hold pixels, a database imported with --encoded holds
+        // compressed images.
+        caffe::Datum datum;
+        if (txn->GetDatum(keys_[0], &datum) && datum.encoded()) {
+            throw std::runtime_error("The database holds encoded images, batches need "
+                                     "raw pixels");
+        }
+    }
+
+    ready_[0] = ready_[1] = false;
+    thread_ = std::thread(&BatchReader::Run, this);
+}
+
+BatchReader::~BatchReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+const Batch& BatchReader::Next() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // The caller is done with the previous batch, hand it back.
+    if (started_) {
+        ready_[current_] = false;
+        current_ ^= 1;
+        changed_.notify_all();
+    }
+    started_ = true;
+
+    changed_.wait(lock, [this] { return ready_[current_]; });
+    records_read_ += batch_size_;
+    return batches_[current_];
+}
+
+void BatchReader::Run() {
+    scoped_ptr<LMDBReadTransaction> txn(db_->NewReadTransaction());
+    std::vector<boost::string_ref> current, next;
+    size_t position = 0;
+    size_t buffer = 0;
+
+    Locate(txn.get(), position, next);
+    while (true) {
+        // Start reading in the batch after this one, then fill this one.
+        current.swap(next);
+        Locate(txn.get(), position + batch_size_, next);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this, buffer] { return stop_ || ! ready_[buffer]; });
+            if (stop_) {
+                return;
+            }
+        }
+
+        Fill(current, position, batches_[buffer]);
+        position += batch_size_;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_[buffer] = true;
+        }
+        changed_.notify_all();
+        buffer ^= 1;
+    }
+}
+
+const std::string& BatchReader::KeyAt(size_t position) {
+    size_t epoch = position / keys_.size();
+    size_t index = position % keys_.size();
+
+    if (order_ == SEQUENTIAL) {
+        return keys_[index];
+    }
+    if (epoch != permutation_epoch_) {
+        permutation_.resize(keys_.size());
+        for (size_t i = 0; i < permutation_.size(); ++i) {
+            permutation_[i] = i;
+        }
+        std::mt19937 rng(seed_ + epoch);
+        std::shuffle(permutation_.begin(), permutation_.end(), rng);
+        permutation_epoch_ = epoch;
+    }
+    return keys_[permutation_[index]];
+}
+
+/* Find the records of the batch starting at first, and tell the kernel we
+   will need their pages soon. */
+void BatchReader::Locate(LMDBReadTransaction* txn, size_t first,
+                         std::vector<boost::string_ref>& values) {
+    static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+
+    values.resize(batch_size_);
+    for (size_t i = 0; i < batch_size_; ++i) {
+        if (! txn->Get(KeyAt(first + i), &values[i])) {
+            values[i].clear();
+            continue;
+        }
+        uintptr_t start = reinterpret_cast<uintptr_t>(values[i].data()) & ~(page_size - 1);
+        uintptr_t end = reinterpret_cast<uintptr_t>(values[i].data()) + values[i].size();
+        madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+    }
+}
+
+void BatchReader::Fill(const std::vector<boost::string_ref>& values, size_t first, Batch& batch) {
+    caffe::Datum datum;
+    size_t datum_size = 0;
+
+    batch.epoch = first / keys_.size();
+    batch.labels.resize(values.size());
+
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (! datum.ParseFromArray(values[i].data(), values[i].size())) {
+            LOG(ERROR) << "Failure parsing datum at position " << first + i;
+            batch.labels[i] = -1;
+            continue;
+        }
+
+        // The first datum decides the shape of all batches.
+        if (datum_size == 0) {
+            if (batch.channels == 0) {
+                batch.channels = datum.channels();
+                batch.height = datum.height();
+                batch.width = datum.width();
+            }
+            datum_size = (size_t)batch.channels * batch.height * batch.width;
+            if (float_output_) {
+                batch.float_data.assign(values.size() * datum_size, 0);
+            } else {
+                batch.data.assign(values.size() * datum_size, 0);
+            }
+        }
+        batch.labels[i] = datum.label();
+
+        const std::string& data = datum.data();
+        if (datum.channels() != batch.channels || datum.height() != batch.height ||
+            datum.width() != batch.width ||
+            (data.size() != datum_size && (size_t)datum.float_data_size() != datum_size)) {
+            LOG(ERROR) << "Datum at position " << first + i << " doesn't match the batch shape.";
+            continue;
+        }
+
+        size_t offset = i * datum_size;
+        if (! data.empty()) {
+            if (float_output_) {
+                // The pixels are unsigned, data holds them as chars.
+                const uint8_t* pixels = (const uint8_t*)data.data();
+                std::copy(pixels, pixels + data.size(), batch.float_data.begin() + offset);
+            } else {
+                std::copy(data.begin(), data.end(), batch.data.begin() + offset);
+            }
+        } else {
+            if (float_output_) {
+                std::copy(datum.float_data().begin(), datum.float_data().end(),
+                          batch.float_data.begin() + offset);
+            } else {
+                std::copy(datum.float_data().begin(), datum.float_data().end(),
+                          batch.data.begin() + offset);
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef batch_reader_h
+#define batch_reader_h
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "lmdb.hpp"
+
+/* A batch of records in NCHW layout. */
+struct Batch {
+    Batch() : epoch(0), channels(0), height(0), width(0) { }
+
+    /* Epoch of the first record in the batch. */
+    size_t epoch;
+    int channels;
+    int height;
+    int width;
+    std::vector<int> labels;
+    /* Pixel data, in data or in float_data depending on the reader. */
+    std::vector<uint8_t> data;
+    std::vector<float> float_data;
+};
+
+/* Reads batches of records from a database for training. A background thread
+   prepares the next batch while the caller uses the current one: it asks the
+   kernel to read in the pages of upcoming records with madvise and copies the
+   datums into one contiguous buffer. Batches wrap around at the end of the
+   database, each pass is an epoch. */
+class BatchReader {
+
+public:
+    enum Order { SEQUENTIAL, SHUFFLED };
+
+    /* In SHUFFLED order every epoch visits the records in a new random
+       permutation, derived from seed. Throws std::runtime_error if the
+       database is empty or holds encoded images. */
+    BatchReader(LMDB* db, size_t batch_size, Order order, bool float_output = false,
+                unsigned int seed = 0);
+    virtual ~BatchReader();
+
+    /* Wait for the next batch. The batch stays valid until the next call. */
+    const Batch& Next();
+
+    size_t NrOfRecords() const { return keys_.size(); }
+    size_t NrOfRecordsRead() const { return records_read_; }
+
+private:
+    void Run();
+    void Locate(LMDBReadTransaction* txn, size_t first, std::vector<boost::string_ref>& values);
+    void Fill(const std::vector<boost::string_ref>& values, size_t first, Batch& batch);
+    const std::string& KeyAt(size_t position);
+
+    LMDB* db_;
+    size_t batch_size_;
+    Order order_;
+    bool float_output_;
+    unsigned int seed_;
+
+    std::vector<std::string> keys_;
+    std::vector<size_t> permutation_;
+    size_t permutation_epoch_;
+
+    // Double buffer, shared with the background thread.
+    Batch batches_[2];
+    bool ready_[2];
+    size_t current_;
+    bool started_;
+    bool stop_;
+    size_t records_read_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::thread thread_;
+};
+
+#endif /* batch_reader_h */
@@ -0,0 +1,122 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef blocking_queue_h
+#define blocking_queue_h
+
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+/* A bounded queue between threads. Producers block while the queue holds
+   max_items items or max_bytes bytes, consumers block while it is empty.
+   After Close() consumers drain the remaining items, then Pop returns false.
+   The items are kept in a ring buffer that only grows, so once it is large
+   enough the queue doesn't allocate memory. */
+template <typename T>
+class BlockingQueue {
+
+public:
+    BlockingQueue(size_t max_items, size_t max_bytes) :
+        max_items_(max_items), max_bytes_(max_bytes), bytes_(0), first_(0), size_(0),
+        closed_(false) { }
+
+    /* Add an item of the given size. A single item larger than max_bytes is
+       accepted once the queue is empty. Returns false if the queue is closed. */
+    bool Push(T item, size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this, bytes] { return closed_ || HasRoomFor(bytes); });
+        if (closed_) {
+            return false;
+        }
+        if (size_ == items_.size()) {
+            Grow();
+        }
+        std::pair<T, size_t>& slot = items_[(first_ + size_) % items_.size()];
+        slot.first = std::move(item);
+        slot.second = bytes;
+        size_ ++;
+        bytes_ += bytes;
+        not_empty_.notify_one();
+        return true;
+    }
+
+    /* Take the oldest item. Returns false when the queue is closed and empty. */
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || size_ > 0; });
+        if (size_ == 0) {
+            return false;
+        }
+        item = std::move(items_[first_].first);
+        bytes_ -= items_[first_].second;
+        first_ = (first_ + 1) % items_.size();
+        size_ --;
+        not_full_.notify_one();
+        return true;
+    }
+
+    /* Signal end of stream. */
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return size_;
+    }
+
+    size_t Bytes() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+private:
+    bool HasRoomFor(size_t bytes) const {
+        if (size_ == 0) {
+            return true;
+        }
+        return size_ < max_items_ && bytes_ + bytes <= max_bytes_;
+    }
+
+    /* Double the ring buffer, with the items in order from the start. */
+    void Grow() {
+        std::vector<std::pair<T, size_t> > items(std::max<size_t>(16, 2 * items_.size()));
+
+        for (size_t i = 0; i < size_; ++i) {
+            items[i] = std::move(items_[(first_ + i) % items_.size()]);
+        }
+        items_.swap(items);
+        first_ = 0;
+    }
+
+    std::vector<std::pair<T, size_t> > items_;
+    size_t max_items_;
+    size_t max_bytes_;
+    size_t bytes_;
+    size_t first_;
+    size_t size_;
+    bool closed_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
+#endif /* blocking_queue_h */
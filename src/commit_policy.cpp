@@ -0,0 +1,89 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "commit_policy.hpp"
+
+#include <algorithm>
+
+#include "glog/logging.h"
+
+const size_t CommitPolicy::SMALLEST_BATCH;
+const size_t CommitPolicy::LARGEST_BATCH;
+
+CommitPolicy::CommitPolicy(size_t max_bytes, double max_seconds, double max_commit_seconds,
+                           size_t batch_size) :
+    max_bytes_(max_bytes), max_seconds_(max_seconds), max_commit_seconds_(max_commit_seconds),
+    batch_size_(std::max(SMALLEST_BATCH, std::min(LARGEST_BATCH, batch_size))),
+    records_(0), bytes_(0), batch_start_(std::chrono::steady_clock::now()),
+    commits_(0), min_batch_size_(0), max_batch_size_(0) { }
+
+bool CommitPolicy::Add(size_t bytes) {
+    if (records_ == 0) {
+        batch_start_ = std::chrono::steady_clock::now();
+    }
+    records_ ++;
+    bytes_ += bytes;
+
+    if (records_ >= batch_size_ || (max_bytes_ > 0 && bytes_ >= max_bytes_)) {
+        return true;
+    }
+    if (max_seconds_ > 0) {
+        std::chrono::duration<double> age = std::chrono::steady_clock::now() - batch_start_;
+        return age.count() >= max_seconds_;
+    }
+    return false;
+}
+
+void CommitPolicy::Committed(double commit_seconds) {
+    // batch_start_ is only set by the first Add of a batch.
+    if (records_ == 0) {
+        return;
+    }
+    std::chrono::duration<double> age = std::chrono::steady_clock::now() - batch_start_;
+    Committed(std::max(0.0, age.count() - commit_seconds), commit_seconds);
+}
+
+void CommitPolicy::Committed(double batch_seconds, double commit_seconds) {
+    size_t old_batch_size = batch_size_;
+
+    if (records_ == 0) {
+        return;
+    }
+    if (commits_ == 0 || records_ < min_batch_size_) {
+        min_batch_size_ = records_;
+    }
+    max_batch_size_ = std::max(max_batch_size_, records_);
+    commits_ ++;
+
+    if (max_commit_seconds_ > 0 && commit_seconds > max_commit_seconds_) {
+        // Too many dirty pages per commit, make the batches smaller.
+        batch_size_ = std::max<size_t>(records_ * max_commit_seconds_ / commit_seconds,
+                                       SMALLEST_BATCH);
+    } else if (records_ >= batch_size_ && commit_seconds > 0.1 * (batch_seconds + commit_seconds)) {
+        // Committing is a large part of the work, spread its fixed cost over
+        // more records. Only grow when the batch was limited by its count,
+        // not by its size or age.
+        batch_size_ = std::min(batch_size_ * 2, LARGEST_BATCH);
+    }
+
+    if (batch_size_ != old_batch_size) {
+        LOG(INFO) << "Commit batch size changed from " << old_batch_size << " to "
+                  << batch_size_ << " records (last commit: " << records_ << " records, "
+                  << (bytes_ >> 10) << " KB in " << commit_seconds << " s).";
+    }
+
+    records_ = 0;
+    bytes_ = 0;
+}
@@ -0,0 +1,70 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef commit_policy_h
+#define commit_policy_h
+
+#include <chrono>
+#include <cstddef>
+
+/* Decides when the writer commits its transaction. A batch is committed when
+   it holds batch_size records, max_bytes bytes or is older than max_seconds.
+   After each commit the batch size adapts: it shrinks when the commit took
+   longer than max_commit_seconds, and grows when committing takes a large
+   share of the time spent on the batch. */
+class CommitPolicy {
+
+public:
+    CommitPolicy(size_t max_bytes, double max_seconds, double max_commit_seconds,
+                 size_t batch_size = 1000);
+
+    /* Account for a stored record. Returns true if the batch should be
+       committed now. */
+    bool Add(size_t bytes);
+
+    /* Report how long committing the batch took. Commits of an empty batch
+       aren't counted. */
+    void Committed(double commit_seconds);
+    /* Report the time spent storing the batch and committing it. */
+    void Committed(double batch_seconds, double commit_seconds);
+
+    size_t BatchSize() const { return batch_size_; }
+    size_t Records() const { return records_; }
+    size_t Bytes() const { return bytes_; }
+    size_t NrOfCommits() const { return commits_; }
+    size_t MinBatchSize() const { return min_batch_size_; }
+    size_t MaxBatchSize() const { return max_batch_size_; }
+
+private:
+    static const size_t SMALLEST_BATCH = 16;
+    static const size_t LARGEST_BATCH = 1000000;
+
+    size_t max_bytes_;
+    double max_seconds_;
+    double max_commit_seconds_;
+    size_t batch_size_;
+
+    // Current batch
+    size_t records_;
+    size_t bytes_;
+    std::chrono::steady_clock::time_point batch_start_;
+
+    // Statistics
+    size_t commits_;
+    size_t min_batch_size_;
+    size_t max_batch_size_;
+};
+
+#endif /* commit_policy_h */
@@ -0,0 +1,170 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "db_sync.hpp"
+
+#include <map>
+#include <unordered_map>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <google/protobuf/io/coded_stream.h>
+
+#include "glog/logging.h"
+
+#include "lmdb.hpp"
+#include "metadata.hpp"
+
+using boost::scoped_ptr;
+
+namespace {
+
+/* A record in one of the databases. Without sources, the label is read from
+   the datum. */
+struct Record {
+    size_t db;
+    std::string key;
+    bool has_source;
+    SourceInfo source;
+    bool has_label;
+    int label;
+};
+
+/* Read only the label of a serialized datum, without copying its pixels. */
+bool datum_label(boost::string_ref value, int* label) {
+    using google::protobuf::io::CodedInputStream;
+    CodedInputStream input((const uint8_t*)value.data(), value.size());
+    const uint32_t LABEL_FIELD = caffe::Datum::kLabelFieldNumber;
+
+    for (uint32_t tag = input.ReadTag(); tag != 0; tag = input.ReadTag()) {
+        uint32_t length, fixed32;
+        uint64_t varint;
+        bool read;
+        switch (tag & 7) {
+        case 0:
+            read = input.ReadVarint64(&varint);
+            if (read && (tag >> 3) == LABEL_FIELD) {
+                *label = (int)(int64_t)varint;
+                return true;
+            }
+            break;
+        case 1:
+            read = input.ReadLittleEndian64(&varint);
+            break;
+        case 2:
+            read = input.ReadVarint32(&length) && input.Skip(length);
+            break;
+        case 5:
+            read = input.ReadLittleEndian32(&fixed32);
+            break;
+        default:
+            read = false;
+        }
+        if (! read) {
+            return false;
+        }
+    }
+    return false;
+}
+
+}
+
+SyncPlan plan_sync(const LabelFile& label_file, const std::string& root_folder, const std::vector<std::string>& db_names) {
+    SyncPlan plan;
+    // Records by image path. The same image can be in the label file more
+    // than once, each line matches one record.
+    std::unordered_map<std::string, std::vector<Record> > records;
+
+    plan.delete_keys.resize(db_names.size());
+    for (size_t db_id = 0; db_id < db_names.size(); ++db_id) {
+        std::map<std::string, SourceInfo> sources;
+        Metadata metadata;
+        bool has_sources = metadata.Open(db_names[db_id], false) &&
+                           metadata.ReadSources(&sources);
+
+        LMDB db;
+        db.Open(db_names[db_id], LMDB::READ);
+        scoped_ptr<LMDBReadTransaction> txn(db.NewReadTransaction());
+        scoped_ptr<LMDBCursor> cursor(txn ? txn->NewCursor() : NULL);
+        if (! cursor) {
+            LOG(FATAL) << "Error reading the keys of " << db_names[db_id] << ".";
+        }
+        for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+            Record record;
+            boost::string_ref image_path = key_image_path(cursor->Key());
+            record.db = db_id;
+            record.key = cursor->Key().to_string();
+            if (image_path.empty()) {
+                LOG(WARNING) << "Ignoring record " << record.key << " in " << db_names[db_id] << ".";
+                continue;
+            }
+            std::map<std::string, SourceInfo>::const_iterator source = sources.find(record.key);
+            record.has_source = has_sources && source != sources.end();
+            if (record.has_source) {
+                record.source = source->second;
+            }
+            record.has_label = ! record.has_source && datum_label(cursor->Value(), &record.label);
+            records[image_path.to_string()].push_back(record);
+        }
+        if (! has_sources) {
+            LOG(INFO) << db_names[db_id] << " has no source metadata, images that changed "
+                      << "without a new label aren't imported again.";
+        }
+    }
+
+    boost::string_ref image_path;
+    int label;
+    uint64_t offset = 0;
+    for (size_t line_id = 0; label_file.NextLine(&offset, &image_path, &label); ++line_id) {
+        if (image_path.empty()) {
+            continue;
+        }
+        std::unordered_map<std::string, std::vector<Record> >::iterator it =
+            records.find(image_path.to_string());
+
+        if (it == records.end() || it->second.empty()) {
+            plan.import_lines.push_back(line_id);
+            plan.import_offsets.push_back(label_file.LineOffset(image_path));
+            continue;
+        }
+        Record record = it->second.back();
+        it->second.pop_back();
+        if (record.has_source) {
+            SourceInfo current;
+            std::string full_path = (boost::filesystem::path(root_folder) /
+                                     image_path.to_string()).string();
+            if (! read_source_info(full_path, label, &current) || current != record.source) {
+                plan.delete_keys[record.db].push_back(record.key);
+                plan.import_lines.push_back(line_id);
+                plan.import_offsets.push_back(label_file.LineOffset(image_path));
+                continue;
+            }
+        } else if (record.has_label && record.label != label) {
+            plan.delete_keys[record.db].push_back(record.key);
+            plan.import_lines.push_back(line_id);
+            plan.import_offsets.push_back(label_file.LineOffset(image_path));
+            continue;
+        }
+        plan.unchanged ++;
+    }
+
+    // What's left is no longer in the label file.
+    for (std::unordered_map<std::string, std::vector<Record> >::const_iterator it = records.begin();
+         it != records.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            plan.delete_keys[it->second[i].db].push_back(it->second[i].key);
+        }
+    }
+    return plan;
+}
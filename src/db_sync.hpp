@@ -0,0 +1,48 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef db_sync_h
+#define db_sync_h
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "label_file.hpp"
+
+/* What an incremental import has to do to bring databases in line with a
+   label file. */
+struct SyncPlan {
+    SyncPlan() : unchanged(0) { }
+
+    /* Numbers and offsets of the lines of the label file that have to be
+       imported. */
+    std::vector<size_t> import_lines;
+    std::vector<uint64_t> import_offsets;
+    /* For each database, the keys of the records to remove: their image is
+       no longer in the label file, or it changed and is imported again. */
+    std::vector<std::vector<std::string> > delete_keys;
+    /* Number of records that are kept as they are. */
+    size_t unchanged;
+};
+
+/* Compare the label file with the records in the databases db_names. A record
+   matches a line of the label file when its key holds the same image path.
+   A record is imported again when its label changed. If the databases have
+   metadata with the sources of the records, also when the size or
+   modification time of its image changed. */
+SyncPlan plan_sync(const LabelFile& label_file, const std::string& root_folder, const std::vector<std::string>& db_names);
+
+#endif /* db_sync_h */
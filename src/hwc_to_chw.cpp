@@ -0,0 +1,176 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hwc_to_chw.hpp"
+
+#include <string.h>
+#include <string>
+
+#include "glog/logging.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HWC_TO_CHW_X86
+#include <immintrin.h>
+#endif
+
+/* Convert pixels [first, width) of a row, one at a time. */
+static void hwc_to_chw_row_scalar(const uint8_t* src, int first, int width, int channels,
+                                  size_t plane_size, uint8_t* dst) {
+    for (int w = first; w < width; ++w) {
+        for (int c = 0; c < channels; ++c) {
+            dst[c * plane_size + w] = src[w * channels + c];
+        }
+    }
+}
+
+#ifdef HWC_TO_CHW_X86
+
+/* pshufb masks that gather the bytes of channel c from the 3 registers
+   holding 16 BGR pixels: masks[c][r][i] is the byte of register r that
+   goes to output byte i, or 0x80 for none. */
+struct ShuffleMasks {
+    ShuffleMasks() {
+        for (int c = 0; c < 3; ++c) {
+            for (int r = 0; r < 3; ++r) {
+                for (int i = 0; i < 16; ++i) {
+                    int pos = 3 * i + c - 16 * r;
+                    masks[c][r][i] = (pos >= 0 && pos < 16) ? pos : 0x80;
+                }
+            }
+        }
+    }
+    uint8_t masks[3][3][16];
+};
+
+static const ShuffleMasks shuffle_masks;
+
+__attribute__((target("ssse3")))
+static int hwc_to_chw_row_ssse3(const uint8_t* src, int width, size_t plane_size, uint8_t* dst) {
+    __m128i masks[3][3];
+    for (int c = 0; c < 3; ++c) {
+        for (int r = 0; r < 3; ++r) {
+            masks[c][r] = _mm_loadu_si128((const __m128i*)shuffle_masks.masks[c][r]);
+        }
+    }
+
+    int w = 0;
+    for (; w + 16 <= width; w += 16) {
+        const uint8_t* p = src + 3 * w;
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(p + 32));
+        for (int ch = 0; ch < 3; ++ch) {
+            __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, masks[ch][0]),
+                                                    _mm_shuffle_epi8(b, masks[ch][1])),
+                                       _mm_shuffle_epi8(c, masks[ch][2]));
+            _mm_storeu_si128((__m128i*)(dst + ch * plane_size + w), out);
+        }
+    }
+    return w;
+}
+
+/* Same as the SSSE3 version, on 2 groups of 16 pixels at once: one in each
+   128-bit lane. */
+__attribute__((target("avx2")))
+static int hwc_to_chw_row_avx2(const uint8_t* src, int width, size_t plane_size, uint8_t* dst) {
+    __m256i masks[3][3];
+    for (int c = 0; c < 3; ++c) {
+        for (int r = 0; r < 3; ++r) {
+            masks[c][r] = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i*)shuffle_masks.masks[c][r]));
+        }
+    }
+
+    int w = 0;
+    for (; w + 32 <= width; w += 32) {
+        const uint8_t* p = src + 3 * w;
+        __m256i a = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+            _mm_loadu_si128((const __m128i*)(p + 48)), 1);
+        __m256i b = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(p + 16))),
+            _mm_loadu_si128((const __m128i*)(p + 64)), 1);
+        __m256i c = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(p + 32))),
+            _mm_loadu_si128((const __m128i*)(p + 80)), 1);
+        for (int ch = 0; ch < 3; ++ch) {
+            __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, masks[ch][0]),
+                                                          _mm256_shuffle_epi8(b, masks[ch][1])),
+                                          _mm256_shuffle_epi8(c, masks[ch][2]));
+            _mm256_storeu_si256((__m256i*)(dst + ch * plane_size + w), out);
+        }
+    }
+    return w;
+}
+
+#endif /* HWC_TO_CHW_X86 */
+
+SimdLevel detected_simd_level() {
+#ifdef HWC_TO_CHW_X86
+    static const SimdLevel level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 :
+                                   __builtin_cpu_supports("ssse3") ? SIMD_SSSE3 : SIMD_NONE;
+    return level;
+#else
+    return SIMD_NONE;
+#endif
+}
+
+void hwc_to_chw(const uint8_t* src, size_t src_step, int height, int width, int channels,
+                uint8_t* dst) {
+    hwc_to_chw(src, src_step, height, width, channels, dst, detected_simd_level());
+}
+
+void hwc_to_chw(const uint8_t* src, size_t src_step, int height, int width, int channels,
+                uint8_t* dst, SimdLevel level) {
+    size_t plane_size = (size_t)height * width;
+
+    for (int h = 0; h < height; ++h) {
+        const uint8_t* row = src + h * src_step;
+        uint8_t* out = dst + (size_t)h * width;
+
+        if (channels == 1) {
+            memcpy(out, row, width);
+            continue;
+        }
+        int done = 0;
+#ifdef HWC_TO_CHW_X86
+        if (channels == 3 && level == SIMD_AVX2) {
+            done = hwc_to_chw_row_avx2(row, width, plane_size, out);
+        }
+        if (channels == 3 && level >= SIMD_SSSE3) {
+            done += hwc_to_chw_row_ssse3(row + 3 * done, width - done, plane_size, out + done);
+        }
+#endif
+        hwc_to_chw_row_scalar(row, done, width, channels, plane_size, out);
+    }
+}
+
+void mat_to_datum(const cv::Mat& cv_img, caffe::Datum* datum) {
+    CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+
+    datum->set_channels(cv_img.channels());
+    datum->set_height(cv_img.rows);
+    datum->set_width(cv_img.cols);
+    datum->clear_float_data();
+    datum->set_encoded(false);
+
+    std::string* data = datum->mutable_data();
+    data->resize((size_t)cv_img.channels() * cv_img.rows * cv_img.cols);
+    if (data->empty()) {
+        return;
+    }
+    hwc_to_chw(cv_img.ptr<uint8_t>(0), cv_img.step, cv_img.rows, cv_img.cols, cv_img.channels(),
+               reinterpret_cast<uint8_t*>(&(*data)[0]));
+}
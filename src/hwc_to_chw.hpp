@@ -0,0 +1,43 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef hwc_to_chw_h
+#define hwc_to_chw_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+
+#include "caffe/proto/caffe.pb.h"
+
+/* Instruction sets for the conversion, the best one the CPU supports is
+   picked at runtime. */
+enum SimdLevel { SIMD_NONE, SIMD_SSSE3, SIMD_AVX2 };
+
+SimdLevel detected_simd_level();
+
+/* Convert an 8-bit image from interleaved channels (HWC, rows of src_step
+   bytes) to planar channels (CHW) in dst. */
+void hwc_to_chw(const uint8_t* src, size_t src_step, int height, int width, int channels,
+                uint8_t* dst);
+void hwc_to_chw(const uint8_t* src, size_t src_step, int height, int width, int channels,
+                uint8_t* dst, SimdLevel level);
+
+/* Same result as caffe::CVMatToDatum for 8-bit images, writes the pixels
+   straight into the data of the datum. */
+void mat_to_datum(const cv::Mat& cv_img, caffe::Datum* datum);
+
+#endif /* hwc_to_chw_h */
@@ -0,0 +1,142 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "image_cache.hpp"
+
+#include <sstream>
+#include <sys/stat.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "glog/logging.h"
+
+using boost::scoped_ptr;
+
+// Images are written to the cache in batches of about this size.
+static const size_t BATCH_BYTES = 64 << 20;
+
+// LMDB's default maximum key size.
+static const size_t MAX_KEY_SIZE = 511;
+
+void ImageCache::Open(const std::string& path, const ImageOptions& options,
+                      size_t max_bytes) {
+    LMDB::Options db_options;
+
+    // The map isn't grown while readers look up images, it is as large as
+    // the cache can get.
+    db_options.map_size = max_bytes;
+    db_.Open(path, boost::filesystem::is_directory(path) ? LMDB::WRITE : LMDB::NEW,
+             db_options);
+    options_ = options;
+    max_bytes_ = max_bytes;
+
+    std::ostringstream settings;
+    settings << options.resize_width << "x" << options.resize_height
+             << " " << options.reduced_decode << " " << options.encoded
+             << " " << options.encode_type << " " << options.encode_quality;
+    settings_ = settings.str();
+}
+
+bool ImageCache::Key(const std::string& path, std::string* key) const {
+    struct stat st;
+
+    if (stat(path.c_str(), &st)) {
+        return false;
+    }
+    std::ostringstream out;
+    out << settings_ << " " << st.st_size << " " << st.st_mtime << " " << path;
+    *key = out.str();
+    return key->size() <= MAX_KEY_SIZE;
+}
+
+bool ImageCache::Contains(const std::string& key) {
+    scoped_ptr<LMDBReadTransaction> txn(db_.NewReadTransaction());
+    boost::string_ref value;
+
+    return txn && txn->Get(key, &value);
+}
+
+bool ImageCache::Get(const std::string& key, int label, caffe::Datum* datum) {
+    scoped_ptr<LMDBReadTransaction> txn(db_.NewReadTransaction());
+    boost::string_ref value;
+
+    if (! txn || ! txn->Get(key, &value) || ! datum->ParseFromArray(value.data(), value.size())) {
+        misses_ ++;
+        return false;
+    }
+    datum->set_label(label);
+    hits_ ++;
+    return true;
+}
+
+void ImageCache::Put(const std::string& key, const caffe::Datum& datum) {
+    std::vector<std::pair<std::string, std::string> > batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (full_) {
+            return;
+        }
+        // The label is stored too, but Get replaces it with the one from
+        // the label file.
+        pending_.push_back(std::make_pair(key, std::string()));
+        datum.SerializeToString(&pending_.back().second);
+        pending_bytes_ += key.size() + pending_.back().second.size();
+        if (pending_bytes_ < BATCH_BYTES) {
+            return;
+        }
+        batch.swap(pending_);
+        pending_bytes_ = 0;
+    }
+    Write(batch);
+}
+
+bool ImageCache::Flush() {
+    std::vector<std::pair<std::string, std::string> > batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch.swap(pending_);
+        pending_bytes_ = 0;
+    }
+    return Write(batch);
+}
+
+bool ImageCache::Write(const std::vector<std::pair<std::string, std::string> >& images) {
+    if (images.empty()) {
+        return true;
+    }
+    scoped_ptr<LMDBTransaction> txn(db_.NewTransaction());
+    bool stored = true;
+    for (size_t i = 0; i < images.size() && stored; ++i) {
+        stored = txn->Put(images[i].first, images[i].second);
+    }
+    if (stored && txn->Commit()) {
+        return true;
+    }
+    if (! txn->MapFull()) {
+        LOG(ERROR) << "Error writing to the image cache.";
+        return false;
+    }
+    // A full cache keeps the images it has.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (! full_) {
+        LOG(WARNING) << "The image cache reached its maximum size of "
+                     << (max_bytes_ >> 20) << " MB, no more images are added.";
+    }
+    full_ = true;
+    pending_.clear();
+    pending_bytes_ = 0;
+    return true;
+}
@@ -0,0 +1,79 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef image_cache_h
+#define image_cache_h
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#include "caffe/proto/caffe.pb.h"
+
+#include "image_loader.hpp"
+#include "lmdb.hpp"
+
+/* Keeps loaded images across imports, in an LMDB environment of its own, so
+   importing the same images again with another label file doesn't decode
+   and resize them again. An image is found by its path, the size and
+   modification time of its file and the image options, so a changed file or
+   other options miss the cache. Entries are never removed: the cache stops
+   growing when it reaches its maximum size. Can be shared by reader
+   threads. */
+class ImageCache {
+
+public:
+    ImageCache() : options_(), max_bytes_(0), pending_bytes_(0), full_(false),
+                   hits_(0), misses_(0) { }
+
+    /* Open the cache at path, created if it doesn't exist, for images loaded
+       with options. Throws std::runtime_error if it can't be opened. */
+    void Open(const std::string& path, const ImageOptions& options, size_t max_bytes);
+
+    /* The key of the image file at path, false if the file doesn't exist
+       or the key would be too long for LMDB. */
+    bool Key(const std::string& path, std::string* key) const;
+
+    bool Contains(const std::string& key);
+    /* Load the cached image of key in datum, with label. Counts a hit or a
+       miss. */
+    bool Get(const std::string& key, int label, caffe::Datum* datum);
+    /* Add a loaded image. Images are written in batches, the last one by
+       Flush. */
+    void Put(const std::string& key, const caffe::Datum& datum);
+    bool Flush();
+
+    uint64_t Hits() const { return hits_; }
+    uint64_t Misses() const { return misses_; }
+
+private:
+    bool Write(const std::vector<std::pair<std::string, std::string> >& images);
+
+    LMDB db_;
+    ImageOptions options_;
+    size_t max_bytes_;
+    std::string settings_;
+    std::vector<std::pair<std::string, std::string> > pending_;
+    size_t pending_bytes_;
+    bool full_;
+    std::mutex mutex_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+#endif /* image_cache_h */
@@ -0,0 +1,203 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "image_loader.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "glog/logging.h"
+
+#include "hwc_to_chw.hpp"
+#include "read_ahead.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+/* Lowercase image type without the dot, "jpeg" is the same as "jpg". */
+static std::string image_type(std::string type) {
+    if (! type.empty() && type[0] == '.') {
+        type = type.substr(1);
+    }
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    if (type == "jpeg") {
+        return "jpg";
+    }
+    return type;
+}
+
+bool jpeg_dimensions(const std::vector<uchar>& buf, int* width, int* height) {
+    if (buf.size() < 4 || buf[0] != 0xFF || buf[1] != 0xD8) {
+        return false;
+    }
+
+    // Walk the segments up to the start of frame marker.
+    size_t pos = 2;
+    while (pos + 9 < buf.size()) {
+        if (buf[pos] != 0xFF) {
+            return false;
+        }
+        uchar marker = buf[pos + 1];
+        if (marker == 0xFF) {
+            pos ++;  // fill byte
+            continue;
+        }
+        if (marker >= 0xC0 && marker <= 0xCF &&
+            marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            *height = (buf[pos + 5] << 8) | buf[pos + 6];
+            *width = (buf[pos + 7] << 8) | buf[pos + 8];
+            return true;
+        }
+        pos += 2 + ((buf[pos + 2] << 8) | buf[pos + 3]);
+    }
+    return false;
+}
+
+cv::Mat decode_reduced_image(const std::vector<uchar>& buf, int width, int height) {
+    int flags = cv::IMREAD_COLOR;
+
+    if (buf.empty()) {
+        return cv::Mat();
+    }
+
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 1)
+    int image_width, image_height;
+    if (jpeg_dimensions(buf, &image_width, &image_height)) {
+        // The decoder rounds the scaled size up.
+        if ((image_width + 7) / 8 >= width && (image_height + 7) / 8 >= height) {
+            flags = cv::IMREAD_REDUCED_COLOR_8;
+        } else if ((image_width + 3) / 4 >= width && (image_height + 3) / 4 >= height) {
+            flags = cv::IMREAD_REDUCED_COLOR_4;
+        } else if ((image_width + 1) / 2 >= width && (image_height + 1) / 2 >= height) {
+            flags = cv::IMREAD_REDUCED_COLOR_2;
+        }
+    }
+#endif
+
+    cv::Mat cv_img_origin = cv::imdecode(buf, flags);
+    if (! cv_img_origin.data) {
+        return cv_img_origin;
+    }
+    cv::Mat cv_img;
+    cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
+    return cv_img;
+}
+
+/* Decode the image in buf, resized if needed. */
+static cv::Mat decode_image(const std::vector<uchar>& buf, const ImageOptions& options) {
+    bool resize = options.resize_width > 0 && options.resize_height > 0;
+
+    if (buf.empty()) {
+        return cv::Mat();
+    }
+    if (resize && options.reduced_decode) {
+        return decode_reduced_image(buf, options.resize_width, options.resize_height);
+    }
+    cv::Mat cv_img = cv::imdecode(buf, cv::IMREAD_COLOR);
+    if (! resize || ! cv_img.data) {
+        return cv_img;
+    }
+    cv::Mat cv_img_resized;
+    cv::resize(cv_img, cv_img_resized, cv::Size(options.resize_width, options.resize_height));
+    return cv_img_resized;
+}
+
+static bool encoded_image_to_datum(const std::string& source, const std::vector<uchar>& buf,
+                                   int label, const ImageOptions& options, Datum* datum) {
+    std::string source_type = image_type(boost::filesystem::path(source).extension().string());
+    std::string encode_type = options.encode_type.empty() ? source_type
+                                                          : image_type(options.encode_type);
+    bool resize = options.resize_width > 0 && options.resize_height > 0;
+
+    // Store the file as is when it already has the right size and type.
+    if (! resize && encode_type == source_type) {
+        datum->mutable_data()->assign(buf.begin(), buf.end());
+        datum->set_label(label);
+        datum->set_encoded(true);
+        return true;
+    }
+
+    cv::Mat cv_img = decode_image(buf, options);
+    if (! cv_img.data) {
+        return false;
+    }
+    std::vector<int> params;
+    if (encode_type == "jpg") {
+        params.push_back(cv::IMWRITE_JPEG_QUALITY);
+        params.push_back(options.encode_quality);
+    }
+    std::vector<uchar> encoded;
+    if (! cv::imencode("." + encode_type, cv_img, encoded, params)) {
+        return false;
+    }
+    datum->mutable_data()->assign(encoded.begin(), encoded.end());
+    datum->set_label(label);
+    datum->set_encoded(true);
+    return true;
+}
+
+shared_ptr<Datum> load_image(const std::string& source, int label,
+                             const ImageOptions& options, LoadStatistics* stats) {
+    std::vector<uchar> buf;
+
+    if (! read_file(source, &buf)) {
+        LOG(WARNING) << "Could not load image " << source;
+        return shared_ptr<Datum>();
+    }
+    return load_image(source, buf, label, options, stats);
+}
+
+shared_ptr<Datum> load_image(const std::string& source, const std::vector<uchar>& buf, int label,
+                             const ImageOptions& options, LoadStatistics* stats) {
+    shared_ptr<Datum> datum(new Datum());
+
+    if (! load_image(source, buf, label, options, datum.get(), stats)) {
+        return shared_ptr<Datum>();
+    }
+    return datum;
+}
+
+bool load_image(const std::string& source, const std::vector<uchar>& buf, int label,
+                const ImageOptions& options, Datum* datum, LoadStatistics* stats) {
+    bool success;
+
+    // Clearing keeps the buffers of the fields.
+    datum->Clear();
+    if (options.encoded) {
+        success = encoded_image_to_datum(source, buf, label, options, datum);
+    } else {
+        cv::Mat cv_img = decode_image(buf, options);
+        success = cv_img.data != NULL;
+        if (success) {
+            mat_to_datum(cv_img, datum);
+            datum->set_label(label);
+        }
+    }
+    if (! success) {
+        LOG(WARNING) << "Could not load image " << source;
+        return false;
+    }
+
+    if (stats) {
+        stats->images ++;
+        stats->bytes_in += buf.size();
+        stats->bytes_out += datum->ByteSizeLong();
+    }
+    return true;
+}
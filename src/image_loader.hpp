@@ -0,0 +1,84 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef image_loader_h
+#define image_loader_h
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include "caffe/proto/caffe.pb.h"
+
+using boost::shared_ptr;
+
+/* How images are converted to datums. */
+struct ImageOptions {
+    ImageOptions() : resize_width(0), resize_height(0), reduced_decode(true),
+                     encoded(false), encode_quality(90) { }
+
+    int resize_width;
+    int resize_height;
+    /* When resizing JPEG images, let the decoder scale them down by 1/2, 1/4
+       or 1/8 as long as they stay larger than the target size. */
+    bool reduced_decode;
+    /* Store the encoded image instead of the raw pixels. Images that don't
+       need to change are stored as read from disk, the others are resized
+       and encoded as encode_type, by default the type of the source file. */
+    bool encoded;
+    std::string encode_type;
+    /* Quality of re-encoded JPEG images, 0-100. */
+    int encode_quality;
+};
+
+/* Counts the bytes read from image files and stored in datums. Can be shared
+   by reader threads. */
+struct LoadStatistics {
+    LoadStatistics() : images(0), bytes_in(0), bytes_out(0) { }
+
+    std::atomic<uint64_t> images;
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> bytes_out;
+};
+
+/* Read the width and height from the header of a JPEG image. */
+bool jpeg_dimensions(const std::vector<unsigned char>& buf, int* width, int* height);
+
+/* Decode the image in buf and resize it to width x height. JPEG images are
+   decoded at the smallest scale that is still at least that large. */
+cv::Mat decode_reduced_image(const std::vector<unsigned char>& buf, int width, int height);
+
+/* Load the image at source in a new datum. Returns an empty pointer if the
+   image can't be loaded. */
+shared_ptr<caffe::Datum> load_image(const std::string& source, int label,
+                                    const ImageOptions& options,
+                                    LoadStatistics* stats = NULL);
+/* Same, for an image that was already read: buf holds the contents of the
+   file source. */
+shared_ptr<caffe::Datum> load_image(const std::string& source,
+                                    const std::vector<unsigned char>& buf, int label,
+                                    const ImageOptions& options,
+                                    LoadStatistics* stats = NULL);
+/* Same, in an existing datum, so the memory of its data can be reused.
+   Returns false if the image can't be loaded. */
+bool load_image(const std::string& source, const std::vector<unsigned char>& buf, int label,
+                const ImageOptions& options, caffe::Datum* datum,
+                LoadStatistics* stats = NULL);
+
+#endif /* image_loader_h */
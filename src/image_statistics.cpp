@@ -0,0 +1,145 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "image_statistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// The 32-bit pixel sums can take this many images of 255.
+static const size_t max_images_in_sums = 1 << 24;
+
+ImageStatistics::ImageStatistics() : channels_(0), height_(0), width_(0), same_size_(true),
+                                     images_(0), images_in_sums_(0) { }
+
+void ImageStatistics::Add(const caffe::Datum& datum) {
+    const std::string& data = datum.data();
+    size_t plane_size = (size_t)datum.height() * datum.width();
+
+    if (datum.encoded() || data.empty() || data.size() != plane_size * datum.channels()) {
+        return;
+    }
+    if (images_ == 0) {
+        channels_ = datum.channels();
+        height_ = datum.height();
+        width_ = datum.width();
+        pixel_sums_.assign(data.size(), 0);
+        pixel_totals_.assign(data.size(), 0);
+        channel_pixels_.assign(channels_, 0);
+        channel_sums_.assign(channels_, 0);
+        channel_squares_.assign(channels_, 0);
+    } else if (datum.channels() != channels_) {
+        return;
+    }
+    same_size_ = same_size_ && datum.height() == height_ && datum.width() == width_;
+    images_ ++;
+
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data.data());
+    if (same_size_) {
+        // Plain loops over 8-bit pixels into 32-bit sums, the compiler
+        // vectorizes them.
+        uint32_t* sums = &pixel_sums_[0];
+        for (size_t i = 0; i < data.size(); ++i) {
+            sums[i] += pixels[i];
+        }
+        if (++images_in_sums_ == max_images_in_sums) {
+            Flush();
+        }
+    }
+    for (int c = 0; c < channels_; ++c) {
+        const uint8_t* plane = pixels + c * plane_size;
+        uint64_t sum = 0, squares = 0;
+        // 32-bit partial sums of up to 65536 squares of 255.
+        for (size_t start = 0; start < plane_size; start += 65536) {
+            size_t end = std::min(plane_size, start + 65536);
+            uint32_t block_sum = 0, block_squares = 0;
+            for (size_t i = start; i < end; ++i) {
+                block_sum += plane[i];
+                block_squares += (uint32_t)plane[i] * plane[i];
+            }
+            sum += block_sum;
+            squares += block_squares;
+        }
+        channel_pixels_[c] += plane_size;
+        channel_sums_[c] += sum;
+        channel_squares_[c] += squares;
+    }
+}
+
+void ImageStatistics::Flush() {
+    for (size_t i = 0; i < pixel_sums_.size(); ++i) {
+        pixel_totals_[i] += pixel_sums_[i];
+        pixel_sums_[i] = 0;
+    }
+    images_in_sums_ = 0;
+}
+
+void ImageStatistics::Merge(const ImageStatistics& other) {
+    if (other.images_ == 0) {
+        return;
+    }
+    if (images_ == 0) {
+        *this = other;
+        return;
+    }
+    if (other.channels_ != channels_) {
+        return;
+    }
+    same_size_ = same_size_ && other.same_size_ && other.height_ == height_ &&
+                 other.width_ == width_;
+    if (same_size_) {
+        Flush();
+        for (size_t i = 0; i < pixel_totals_.size(); ++i) {
+            pixel_totals_[i] += other.pixel_totals_[i] + other.pixel_sums_[i];
+        }
+    }
+    for (int c = 0; c < channels_; ++c) {
+        channel_pixels_[c] += other.channel_pixels_[c];
+        channel_sums_[c] += other.channel_sums_[c];
+        channel_squares_[c] += other.channel_squares_[c];
+    }
+    images_ += other.images_;
+}
+
+void ImageStatistics::MeanImage(caffe::BlobProto* blob) const {
+    blob->set_num(1);
+    blob->set_channels(channels_);
+    blob->set_height(height_);
+    blob->set_width(width_);
+    blob->clear_data();
+    if (! HasMeanImage()) {
+        return;
+    }
+    for (size_t i = 0; i < pixel_totals_.size(); ++i) {
+        blob->add_data((float)(pixel_totals_[i] + pixel_sums_[i]) / images_);
+    }
+}
+
+double ImageStatistics::ChannelMean(int channel) const {
+    if (channel >= channels_ || channel_pixels_[channel] == 0) {
+        return 0;
+    }
+    return (double)channel_sums_[channel] / channel_pixels_[channel];
+}
+
+double ImageStatistics::ChannelStd(int channel) const {
+    if (channel >= channels_ || channel_pixels_[channel] == 0) {
+        return 0;
+    }
+    double mean = ChannelMean(channel);
+    double variance = (double)channel_squares_[channel] / channel_pixels_[channel] - mean * mean;
+    return std::sqrt(std::max(0.0, variance));
+}
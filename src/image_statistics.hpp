@@ -0,0 +1,67 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef image_statistics_h
+#define image_statistics_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "caffe/proto/caffe.pb.h"
+
+/* Accumulates the mean image of raw datums, as Caffe's compute_image_mean
+   computes it, and the mean and standard deviation of each channel. Not
+   thread safe: each reader thread keeps its own, they are merged at the
+   end. */
+class ImageStatistics {
+
+public:
+    ImageStatistics();
+
+    /* Add the pixels of a raw datum. The mean image is only kept while all
+       datums have the same size. */
+    void Add(const caffe::Datum& datum);
+    void Merge(const ImageStatistics& other);
+
+    size_t NrOfImages() const { return images_; }
+    /* False if the images didn't all have the same size. */
+    bool HasMeanImage() const { return images_ > 0 && same_size_; }
+    /* The mean image as a 1 x C x H x W blob. */
+    void MeanImage(caffe::BlobProto* blob) const;
+    int Channels() const { return channels_; }
+    double ChannelMean(int channel) const;
+    double ChannelStd(int channel) const;
+
+private:
+    void Flush();
+
+    int channels_;
+    int height_;
+    int width_;
+    bool same_size_;
+    size_t images_;
+    /* Sum of each pixel, the 32-bit sums take the last images and are added
+       to the 64-bit ones before they can overflow. */
+    std::vector<uint32_t> pixel_sums_;
+    std::vector<uint64_t> pixel_totals_;
+    size_t images_in_sums_;
+    /* Per channel, the number of pixels, their sum and the sum of their
+       squares. */
+    std::vector<uint64_t> channel_pixels_;
+    std::vector<uint64_t> channel_sums_;
+    std::vector<uint64_t> channel_squares_;
+};
+
+#endif /* image_statistics_h */
@@ -0,0 +1,133 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "import_order.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "lmdb.hpp"
+#include "metadata.hpp"
+#include "path_index.hpp"
+
+bool parse_partition(const std::string& partition, size_t* part, size_t* nr_of_parts) {
+    char rest;
+
+    if (sscanf(partition.c_str(), "%zu/%zu%c", part, nr_of_parts, &rest) != 2) {
+        return false;
+    }
+    return *nr_of_parts > 0 && *part < *nr_of_parts;
+}
+
+std::vector<size_t> shuffled_positions(size_t n, unsigned int seed) {
+    std::vector<size_t> permutation(n);
+
+    for (size_t position = 0; position < n; ++position) {
+        permutation[position] = position;
+    }
+    std::mt19937 rng(seed);
+    std::shuffle(permutation.begin(), permutation.end(), rng);
+    return permutation;
+}
+
+void import_order(const std::vector<uint64_t>& all_offsets, const ImportOrderOptions& options,
+                  std::vector<uint64_t>* offsets, std::vector<size_t>* line_numbers) {
+    size_t nr_of_lines = all_offsets.size();
+    std::vector<size_t> permutation;
+
+    if (options.shuffle) {
+        permutation = shuffled_positions(nr_of_lines, options.shuffle_seed);
+    } else {
+        permutation.resize(nr_of_lines);
+        for (size_t position = 0; position < nr_of_lines; ++position) {
+            permutation[position] = position;
+        }
+    }
+    size_t begin = nr_of_lines * options.part / options.nr_of_parts;
+    size_t end = nr_of_lines * (options.part + 1) / options.nr_of_parts;
+
+    offsets->clear();
+    line_numbers->clear();
+    for (size_t position = begin; position < end; ++position) {
+        if (options.shuffle_keys) {
+            // Line p is read in order and stored under key permutation[p].
+            offsets->push_back(all_offsets[position]);
+            line_numbers->push_back(permutation[position]);
+        } else {
+            // Line permutation[p] is read at position p and stored under
+            // key p.
+            offsets->push_back(all_offsets[permutation[position]]);
+            line_numbers->push_back(position);
+        }
+    }
+}
+
+void line_key(size_t line_number, boost::string_ref image_path, bool integer_keys,
+              std::string* key) {
+    if (integer_keys) {
+        integer_key(line_number, key);
+    } else {
+        record_key(line_number, image_path, key);
+    }
+}
+
+std::string shard_name(const std::string& db_name, size_t shard) {
+    char suffix[32];
+
+    snprintf(suffix, sizeof(suffix), "_%02zu", shard);
+    return db_name + suffix;
+}
+
+bool write_shard_manifest(const std::string& db_name, const std::vector<std::string>& shard_names,
+                          bool integer_keys) {
+    std::ofstream manifest((db_name + ".manifest").c_str());
+
+    manifest << "partitioning round_robin\n";
+    manifest << "shards " << shard_names.size() << "\n";
+    LMDB::Options options;
+    options.integer_keys = integer_keys;
+    for (size_t shard = 0; shard < shard_names.size(); ++shard) {
+        LMDB db;
+        db.Open(shard_names[shard], LMDB::READ, options);
+        manifest << "shard " << shard << " " << shard_names[shard] << " "
+                 << db.NrOfEntries() << "\n";
+    }
+    manifest.close();
+    return ! manifest.fail();
+}
+
+bool read_shard_manifest(const std::string& db_name, ShardManifest* manifest) {
+    std::ifstream in((db_name + ".manifest").c_str());
+    std::string word, partitioning;
+    size_t nr_of_shards;
+
+    if (! (in >> word >> partitioning) || word != "partitioning" ||
+        partitioning != "round_robin" || ! (in >> word >> nr_of_shards) || word != "shards") {
+        return false;
+    }
+    manifest->databases.resize(nr_of_shards);
+    manifest->nr_of_records.resize(nr_of_shards);
+    for (size_t i = 0; i < nr_of_shards; ++i) {
+        size_t shard;
+        if (! (in >> word >> shard) || word != "shard" || shard != i ||
+            ! (in >> manifest->databases[i] >> manifest->nr_of_records[i])) {
+            return false;
+        }
+    }
+    return true;
+}
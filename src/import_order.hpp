@@ -0,0 +1,109 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef import_order_h
+#define import_order_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+
+/* Routes the lines of an import through the readers and writers. The line
+   at position p of the import is loaded by reader p % R and stored by the
+   writer of shard p % S. A writer takes the positions of its shard in
+   increasing order, each from the queue of the reader that loaded it, so
+   the records are stored in the same order and under the same keys
+   whatever the number of readers. */
+class ImportRouting {
+
+public:
+    ImportRouting(size_t nr_of_readers, size_t nr_of_shards) :
+        nr_of_readers_(nr_of_readers), nr_of_shards_(nr_of_shards) { }
+
+    size_t Reader(size_t position) const { return position % nr_of_readers_; }
+    size_t Shard(size_t position) const { return position % nr_of_shards_; }
+    /* The position after position in the same shard. */
+    size_t NextInShard(size_t position) const { return position + nr_of_shards_; }
+
+    size_t NrOfReaders() const { return nr_of_readers_; }
+    size_t NrOfShards() const { return nr_of_shards_; }
+
+private:
+    size_t nr_of_readers_;
+    size_t nr_of_shards_;
+};
+
+/* Which lines an import reads, and in which order. */
+struct ImportOrderOptions {
+    ImportOrderOptions() : shuffle(false), shuffle_keys(false), shuffle_seed(0),
+                           part(0), nr_of_parts(1) { }
+
+    /* Import the lines in a random order, the same for the same seed. */
+    bool shuffle;
+    /* Read the images in file order and shuffle the keys instead. */
+    bool shuffle_keys;
+    unsigned int shuffle_seed;
+    /* Only import part part of nr_of_parts equal parts of the import. */
+    size_t part;
+    size_t nr_of_parts;
+};
+
+/* Parse the value of --partition, I/N. */
+bool parse_partition(const std::string& partition, size_t* part, size_t* nr_of_parts);
+
+/* A random permutation of the positions 0 to n-1, the same for the same
+   seed. */
+std::vector<size_t> shuffled_positions(size_t n, unsigned int seed);
+
+/* The lines imported with options, from the offsets of all lines of the
+   label file: the line at position p of the import is read at offsets[p]
+   and stored under the key of line line_numbers[p]. The keys don't depend
+   on the partitioning, so the parts together hold the records of a full
+   import. */
+void import_order(const std::vector<uint64_t>& all_offsets, const ImportOrderOptions& options,
+                  std::vector<uint64_t>* offsets, std::vector<size_t>* line_numbers);
+
+/* The key of the record of line line_number: an integer key, see
+   integer_key, or <line number>_<image path>, see record_key. The key only
+   depends on the line, not on its position in the import. */
+void line_key(size_t line_number, boost::string_ref image_path, bool integer_keys,
+              std::string* key);
+
+/* Name of the database of shard, e.g. DB_NAME_03. */
+std::string shard_name(const std::string& db_name, size_t shard);
+
+/* How the images are spread over the shards, see ImportRouting. It is
+   stored in DB_NAME.manifest:
+
+     partitioning round_robin
+     shards <S>
+     shard <i> <database> <nr of records>
+
+   The line at position p of the import is stored in shard p % S. That is
+   line p of the label file, unless the import was shuffled or synced. */
+struct ShardManifest {
+    std::vector<std::string> databases;
+    std::vector<size_t> nr_of_records;
+};
+
+/* Count the records of the databases shard_names and write the manifest of
+   db_name. */
+bool write_shard_manifest(const std::string& db_name, const std::vector<std::string>& shard_names,
+                          bool integer_keys);
+/* Read the manifest of db_name. Returns false if it's missing or invalid. */
+bool read_shard_manifest(const std::string& db_name, ShardManifest* manifest);
+
+#endif /* import_order_h */
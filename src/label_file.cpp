@@ -0,0 +1,164 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "label_file.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+
+const char LabelFile::SEPARATOR;
+
+void LabelFile::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd < 0) {
+        throw std::runtime_error("Failure opening label file " + path);
+    }
+    if (fstat(fd, &st)) {
+        close(fd);
+        throw std::runtime_error("Failure reading label file " + path);
+    }
+    size_ = st.st_size;
+    if (size_ > 0) {
+        void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            size_ = 0;
+            throw std::runtime_error("Failure mapping label file " + path);
+        }
+        // The file is mostly read front to back.
+        madvise(data, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(data);
+    }
+    close(fd);
+}
+
+void LabelFile::Close() {
+    if (data_ != NULL) {
+        munmap(const_cast<char*>(data_), size_);
+        data_ = NULL;
+    }
+    size_ = 0;
+}
+
+bool LabelFile::NextLine(uint64_t* offset, boost::string_ref* path, int* label) const {
+    if (*offset >= size_) {
+        return false;
+    }
+    const char* end = static_cast<const char*>(memchr(data_ + *offset, '\n', size_ - *offset));
+    size_t length = end ? end - (data_ + *offset) : size_ - *offset;
+    boost::string_ref line(data_ + *offset, length);
+
+    size_t pos = line.rfind(SEPARATOR);
+    *path = line.substr(0, pos);
+    // Same as atoi on the text after the separator.
+    const char* p = line.data() + (pos == boost::string_ref::npos ? 0 : pos + 1);
+    const char* line_end = line.data() + line.size();
+    bool negative = false;
+    *label = 0;
+    while (p < line_end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    if (p < line_end && (*p == '-' || *p == '+')) {
+        negative = (*p++ == '-');
+    }
+    for (; p < line_end && *p >= '0' && *p <= '9'; ++p) {
+        *label = *label * 10 + (*p - '0');
+    }
+    if (negative) {
+        *label = -*label;
+    }
+
+    *offset += length + 1;
+    return true;
+}
+
+void LabelFile::LineAt(uint64_t offset, boost::string_ref* path, int* label) const {
+    NextLine(&offset, path, label);
+}
+
+void LabelFile::BuildIndex(std::vector<uint64_t>* offsets) const {
+    boost::string_ref path;
+    int label;
+
+    offsets->clear();
+    for (uint64_t offset = 0; NextLine(&offset, &path, &label); ) {
+        offsets->push_back(LineOffset(path));
+    }
+}
+
+size_t LabelFile::CountLines() const {
+    size_t count = 0;
+
+    for (size_t offset = 0; offset < size_; ) {
+        const char* end = static_cast<const char*>(memchr(data_ + offset, '\n', size_ - offset));
+        offset = end ? end - data_ + 1 : size_;
+        count ++;
+    }
+    return count;
+}
+
+std::vector<std::pair<std::string, int> > LabelFile::Sample(size_t n) const {
+    std::vector<std::pair<std::string, int> > lines;
+    boost::string_ref path;
+    int label;
+    uint64_t previous = size_;
+
+    for (size_t i = 0; i < n; ++i) {
+        // The first line that starts after offset i / n of the file.
+        uint64_t offset = size_ * i / n;
+        if (offset > 0) {
+            const char* end = static_cast<const char*>(memchr(data_ + offset - 1, '\n',
+                                                              size_ - offset + 1));
+            offset = end ? end - data_ + 1 : size_;
+        }
+        if (offset != previous && NextLine(&offset, &path, &label) && ! path.empty()) {
+            previous = LineOffset(path);
+            lines.push_back(std::make_pair(path.to_string(), label));
+        }
+    }
+    return lines;
+}
+
+uint64_t LabelFile::Hash() const {
+    static const size_t BLOCK_SIZE = 4096;
+    static const size_t NR_OF_BLOCKS = 256;
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < sizeof(size_); ++i) {
+        hash = (hash ^ (unsigned char)(size_ >> (8 * i))) * 1099511628211ULL;
+    }
+    // Small files are hashed completely, larger ones in blocks spread evenly
+    // from the first to the last byte.
+    size_t nr_of_blocks = std::min(NR_OF_BLOCKS, (size_ + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    for (size_t block = 0; block < nr_of_blocks; ++block) {
+        size_t begin = nr_of_blocks == 1 ? 0 :
+                       (size_ - BLOCK_SIZE) / (nr_of_blocks - 1) * block;
+        if (block == nr_of_blocks - 1) {
+            begin = size_ - std::min(size_, BLOCK_SIZE);
+        }
+        size_t end = std::min(size_, begin + BLOCK_SIZE);
+        for (size_t i = begin; i < end; ++i) {
+            hash = (hash ^ (unsigned char)data_[i]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,64 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef label_file_h
+#define label_file_h
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <boost/utility/string_ref.hpp>
+
+/* A label file with lines <image path><SEPARATOR><label>, memory mapped so it
+   can be parsed while the images are imported, without keeping the lines in
+   memory. Empty lines have an empty path, so lines are numbered as in the
+   file, as the import always did. Positions of lines are byte offsets in the
+   file, a list of them is a compact index for random access. */
+class LabelFile {
+
+public:
+    static const char SEPARATOR = ' ';
+
+    LabelFile() : data_(NULL), size_(0) { }
+    virtual ~LabelFile() { Close(); }
+    void Open(const std::string& path);
+    void Close();
+
+    /* Parse the line at *offset and move *offset to the next line. Returns
+       false at the end of the file. The path points into the mapped file. */
+    bool NextLine(uint64_t* offset, boost::string_ref* path, int* label) const;
+    /* Offset of the line of a path returned by NextLine or LineAt. */
+    uint64_t LineOffset(boost::string_ref path) const { return path.data() - data_; }
+    /* Parse the line at offset, which must be the start of a line. */
+    void LineAt(uint64_t offset, boost::string_ref* path, int* label) const;
+
+    /* Offsets of all lines. */
+    void BuildIndex(std::vector<uint64_t>* offsets) const;
+    size_t CountLines() const;
+    /* Up to n non-empty lines spread over the file. */
+    std::vector<std::pair<std::string, int> > Sample(size_t n) const;
+    /* Identifies the contents of the file, to check that an import is
+       resumed with the same label file. FNV-1a over the size and up to 1 MB
+       of the file: all of a small file, evenly spread blocks of a large
+       one, so it doesn't read a large file completely. */
+    uint64_t Hash() const;
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+#endif /* label_file_h */
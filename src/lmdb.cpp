@@ -29,7 +29,10 @@
 using namespace caffe;  // NOLINT(build/namespaces)
 using boost::scoped_ptr;
 
-void LMDB::Open(const std::string& source, LMDB::Mode mode) {
+const char* const LMDB::RECORDS_DB = "records";
+
+void LMDB::Open(const std::string& source, LMDB::Mode mode, const LMDB::Options& options) {
+    unsigned int flags = 0;
 
     // Create the target folder for a new database
     if (mode == LMDB::NEW) {
@@ -40,25 +43,71 @@ void LMDB::Open(const std::string& source, LMDB::Mode mode) {
 
     if (int error = mdb_env_create(&mdb_env_)) {
         mdb_env_close(mdb_env_);
+        mdb_env_ = NULL;
         throw std::runtime_error("Failure creating LMDB environment");
     }
 
-    if (int error = mdb_env_open(mdb_env_, source.c_str(), 0, 0664)) {
+    if (options.map_size > 0 && mdb_env_set_mapsize(mdb_env_, options.map_size)) {
+        mdb_env_close(mdb_env_);
+        mdb_env_ = NULL;
+        throw std::runtime_error("Failure setting LMDB map size");
+    }
+
+    // The records database of integer keys is one more named database.
+    unsigned int max_dbs = options.max_dbs + (options.integer_keys ? 1 : 0);
+    if (max_dbs > 0 && mdb_env_set_maxdbs(mdb_env_, max_dbs)) {
         mdb_env_close(mdb_env_);
+        mdb_env_ = NULL;
+        throw std::runtime_error("Failure setting LMDB max dbs");
+    }
+
+    // Allow more than one read transaction per thread.
+    if (mode == LMDB::READ) {
+        flags |= MDB_RDONLY | MDB_NOTLS;
+    }
+
+    // Write through the memory map and leave flushing it to the OS, the data
+    // is synced once in Close.
+    if (options.fast_import) {
+        flags |= MDB_NOSYNC | MDB_NOMETASYNC | MDB_WRITEMAP | MDB_MAPASYNC;
+    }
+
+    if (int error = mdb_env_open(mdb_env_, source.c_str(), flags, 0664)) {
+        mdb_env_close(mdb_env_);
+        mdb_env_ = NULL;
         throw std::runtime_error("Failure opening LMDB environment");
     }
+    read_only_ = (mode == LMDB::READ);
+    sync_on_close_ = options.fast_import;
+
+    integer_keys_ = options.integer_keys;
+    if (integer_keys_ && ! OpenSubDatabase(RECORDS_DB, true, &mdb_dbi_, MDB_INTEGERKEY)) {
+        mdb_env_close(mdb_env_);
+        mdb_env_ = NULL;
+        throw std::runtime_error("Failure opening the LMDB records database");
+    }
 
     // db connection created
 }
 
 void LMDB::Close() {
     if (mdb_env_ != NULL) {
-        mdb_dbi_close(mdb_env_, mdb_dbi_);
+        if (sync_on_close_ && ! Sync()) {
+            LOG(ERROR) << "Failure syncing LMDB environment.";
+        }
+        if (integer_keys_) {
+            mdb_dbi_close(mdb_env_, mdb_dbi_);
+        }
         mdb_env_close(mdb_env_);
         mdb_env_ = NULL;
     }
 }
 
+// Flush all committed transactions to disk.
+bool LMDB::Sync() {
+    return mdb_env_sync(mdb_env_, 1) == 0;
+}
+
 bool LMDB::StoreDatum(const std::string &key, const caffe::Datum * datum) {
 
     // Create transaction, add and commit.
@@ -77,14 +126,12 @@ bool LMDB::StoreString(LMDBTransaction *txn, const std::string &key, const std::
 
 bool LMDB::StoreDatum(LMDBTransaction *txn, const std::string &key, const Datum* datum) {
 
-    std::string out;
-    if (datum->SerializeToString(&out)) {
-        return StoreString(txn, key, out);
-    }
-    return false;
+    return txn->PutDatum(key, *datum);
 }
 
-LMDBTransaction* LMDB::NewTransaction() {
+// In append mode keys are expected in increasing order. LMDB then adds them
+// at the end of the B-tree without searching and keeps the pages full.
+LMDBTransaction* LMDB::NewTransaction(bool append) {
     MDB_dbi mdb_dbi;
     MDB_txn *mdb_txn;
 
@@ -92,17 +139,51 @@ LMDBTransaction* LMDB::NewTransaction() {
     if (mdb_txn_begin(mdb_env_, NULL /* no parent */, 0 /* rw */, &mdb_txn)) {
         return NULL;
     }
-    if (mdb_dbi_open(mdb_txn, NULL, 0, &mdb_dbi)) {
+    if (! OpenDatabase(mdb_txn, &mdb_dbi)) {
+        mdb_txn_abort(mdb_txn);
         return NULL;
     }
 
-    return new LMDBTransaction(mdb_txn, mdb_dbi);
+    return new LMDBTransaction(mdb_txn, mdb_dbi, append);
 }
 
+LMDBReadTransaction* LMDB::NewReadTransaction() {
+    MDB_dbi mdb_dbi;
+    MDB_txn *mdb_txn;
+
+    if (mdb_txn_begin(mdb_env_, NULL /* no parent */, MDB_RDONLY, &mdb_txn)) {
+        return NULL;
+    }
+    if (! OpenDatabase(mdb_txn, &mdb_dbi)) {
+        mdb_txn_abort(mdb_txn);
+        return NULL;
+    }
+
+    return new LMDBReadTransaction(mdb_txn, mdb_dbi);
+}
+
+// The database of the records: the main database, or the records database
+// opened in Open.
+bool LMDB::OpenDatabase(MDB_txn* mdb_txn, MDB_dbi* mdb_dbi) {
+    if (integer_keys_) {
+        *mdb_dbi = mdb_dbi_;
+        return true;
+    }
+    return mdb_dbi_open(mdb_txn, NULL, 0, mdb_dbi) == 0;
+}
 
 size_t LMDB::NrOfEntries() {
     MDB_stat stat;
 
+    if (integer_keys_) {
+        MDB_txn *mdb_txn;
+        if (mdb_txn_begin(mdb_env_, NULL, MDB_RDONLY, &mdb_txn)) {
+            return SIZE_MAX;
+        }
+        int rc = mdb_stat(mdb_txn, mdb_dbi_, &stat);
+        mdb_txn_abort(mdb_txn);
+        return rc ? SIZE_MAX : stat.ms_entries;
+    }
     if (! mdb_env_stat(mdb_env_, &stat)) {
         return stat.ms_entries;
     }
@@ -110,11 +191,54 @@ size_t LMDB::NrOfEntries() {
     return SIZE_MAX;
 }
 
+size_t LMDB::MapSize() {
+    MDB_envinfo info;
+
+    if (! mdb_env_info(mdb_env_, &info)) {
+        return info.me_mapsize;
+    }
+
+    return 0;
+}
+
+// Double the map size. No transaction may be active in this process.
+bool LMDB::GrowMapSize() {
+    size_t new_size = MapSize() * 2;
+
+    if (new_size == 0 || mdb_env_set_mapsize(mdb_env_, new_size)) {
+        return false;
+    }
+    LOG(INFO) << "Grew the map size to " << (new_size >> 20) << " MB.";
+    return true;
+}
+
+bool LMDB::OpenSubDatabase(const std::string& name, bool create, MDB_dbi* sub_db,
+                           unsigned int flags) {
+    MDB_txn *mdb_txn;
+
+    // The handle is shared by all later transactions once this one commits.
+    if (mdb_txn_begin(mdb_env_, NULL, read_only_ ? MDB_RDONLY : 0, &mdb_txn)) {
+        return false;
+    }
+    if (create && ! read_only_) {
+        flags |= MDB_CREATE;
+    }
+    int rc = mdb_dbi_open(mdb_txn, name.c_str(), flags, sub_db);
+    if (rc) {
+        if (rc != MDB_NOTFOUND) {
+            LOG(ERROR) << "Opening database " << name << " failed: " << mdb_strerror(rc);
+        }
+        mdb_txn_abort(mdb_txn);
+        return false;
+    }
+    return mdb_txn_commit(mdb_txn) == 0;
+}
+
 /******************************************************************************/
 /* LMDBTransaction                                                            */
 /*                                                                            */
 /******************************************************************************/
-bool LMDBTransaction::Put(const std::string& key, const std::string& value) {
+bool LMDBTransaction::Put(boost::string_ref key, boost::string_ref value) {
 
     MDB_val mdb_key, mdb_data;
 
@@ -123,54 +247,234 @@ bool LMDBTransaction::Put(const std::string& key, const std::string& value) {
     mdb_data.mv_size = value.size();
     mdb_data.mv_data = const_cast<char*>(value.data());
 
-    int put_rc = mdb_put(mdb_txn_, mdb_dbi_, &mdb_key, &mdb_data, 0);
+    int put_rc = PutVal(&mdb_key, &mdb_data, 0);
     if (! put_rc) {
         return true;
     }
-    LOG(ERROR) << "Txn Put failed. Aborting!" << put_rc;
-    if (put_rc == MDB_MAP_FULL) {
-        // Maximum map size exceeded, resize is needed.
-        // We let the caller handle that.
+    // A full map is handled by the caller.
+    if (put_rc != MDB_MAP_FULL) {
+        LOG(ERROR) << "Txn Put failed: " << mdb_strerror(put_rc);
+    }
+    return false;
+}
+
+// Serialize the datum directly in the space reserved for it in the database,
+// without an intermediate copy.
+bool LMDBTransaction::PutDatum(const std::string& key, const caffe::Datum& datum) {
+
+    MDB_val mdb_key, mdb_data;
 
-        // TODO: exception
+    mdb_key.mv_size = key.size();
+    mdb_key.mv_data = const_cast<char*>(key.data());
+    mdb_data.mv_size = datum.ByteSizeLong();
+    mdb_data.mv_data = NULL;
+
+    int put_rc = PutVal(&mdb_key, &mdb_data, MDB_RESERVE);
+    if (put_rc) {
+        if (put_rc != MDB_MAP_FULL) {
+            LOG(ERROR) << "Txn Put failed: " << mdb_strerror(put_rc);
+        }
         return false;
     }
-    return false;
+    datum.SerializeWithCachedSizesToArray(static_cast<uint8_t*>(mdb_data.mv_data));
+    return true;
 }
 
-bool LMDBTransaction::Commit() {
-    MDB_env *env = mdb_txn_env(mdb_txn_);
+bool LMDBTransaction::Put(MDB_dbi sub_db, boost::string_ref key, boost::string_ref value) {
 
-    // Commit the transaction
-    int commit_rc = mdb_txn_commit(mdb_txn_);
-    if (! commit_rc) {
-        return true;
+    MDB_val mdb_key, mdb_data;
+
+    mdb_key.mv_size = key.size();
+    mdb_key.mv_data = const_cast<char*>(key.data());
+    mdb_data.mv_size = value.size();
+    mdb_data.mv_data = const_cast<char*>(value.data());
+
+    last_rc_ = mdb_put(mdb_txn_, sub_db, &mdb_key, &mdb_data, 0);
+    if (last_rc_ && last_rc_ != MDB_MAP_FULL) {
+        LOG(ERROR) << "Txn Put failed: " << mdb_strerror(last_rc_);
     }
-    // Cleanup after successful commit
-    mdb_dbi_close(env, mdb_dbi_);
+    return last_rc_ == 0;
+}
+
+bool LMDBTransaction::Get(MDB_dbi sub_db, const std::string& key, boost::string_ref* value) {
+
+    MDB_val mdb_key, mdb_data;
 
+    mdb_key.mv_size = key.size();
+    mdb_key.mv_data = const_cast<char*>(key.data());
+
+    int get_rc = mdb_get(mdb_txn_, sub_db, &mdb_key, &mdb_data);
+    if (get_rc) {
+        if (get_rc != MDB_NOTFOUND) {
+            LOG(ERROR) << "Txn Get failed: " << mdb_strerror(get_rc);
+        }
+        return false;
+    }
+    *value = boost::string_ref(static_cast<const char*>(mdb_data.mv_data), mdb_data.mv_size);
     return true;
 }
 
-bool LMDBTransaction::CommitAndDoubleMapSize() {
-    if (! Commit()) {
+bool LMDBTransaction::Delete(const std::string& key) {
+    return Delete(mdb_dbi_, key);
+}
+
+bool LMDBTransaction::Delete(MDB_dbi sub_db, const std::string& key) {
+
+    MDB_val mdb_key;
+
+    mdb_key.mv_size = key.size();
+    mdb_key.mv_data = const_cast<char*>(key.data());
+
+    int del_rc = mdb_del(mdb_txn_, sub_db, &mdb_key, NULL);
+    if (del_rc && del_rc != MDB_NOTFOUND) {
+        last_rc_ = del_rc;
+        if (del_rc != MDB_MAP_FULL) {
+            LOG(ERROR) << "Txn Delete failed: " << mdb_strerror(del_rc);
+        }
         return false;
     }
+    return true;
+}
 
-    // Transaction is out of the way, now double the map size.
-    struct MDB_envinfo current_info;
-    MDB_env *env = mdb_txn_env(mdb_txn_);
+int LMDBTransaction::PutVal(MDB_val *mdb_key, MDB_val *mdb_data, unsigned int flags) {
 
-    int rc = mdb_env_info(env, &current_info);
-    if (rc) {
-        return false;
+    if (append_) {
+        MDB_val append_data = *mdb_data;
+        int put_rc = mdb_put(mdb_txn_, mdb_dbi_, mdb_key, &append_data, flags | MDB_APPEND);
+        if (put_rc != MDB_KEYEXIST) {
+            *mdb_data = append_data;
+            last_rc_ = put_rc;
+            return put_rc;
+        }
+        // The key isn't larger than the last key in the database, fall back
+        // to regular puts for the rest of this transaction.
+        LOG(WARNING) << "Keys not in increasing order, leaving append mode.";
+        append_ = false;
     }
-    size_t new_size = current_info.me_mapsize * 2;
-    rc = mdb_env_set_mapsize(env, new_size);
-    if (rc) {
+    last_rc_ = mdb_put(mdb_txn_, mdb_dbi_, mdb_key, mdb_data, flags);
+    return last_rc_;
+}
+
+bool LMDBTransaction::Commit() {
+
+    // Commit the transaction, this releases it also when the commit fails.
+    last_rc_ = mdb_txn_commit(mdb_txn_);
+    mdb_txn_ = NULL;
+    if (! last_rc_) {
+        return true;
+    }
+    if (last_rc_ != MDB_MAP_FULL) {
+        LOG(ERROR) << "Txn Commit failed: " << mdb_strerror(last_rc_);
+    }
+    return false;
+}
+
+void LMDBTransaction::Abort() {
+    if (mdb_txn_ != NULL) {
+        mdb_txn_abort(mdb_txn_);
+        mdb_txn_ = NULL;
+    }
+}
+
+/******************************************************************************/
+/* LMDBReadTransaction                                                        */
+/*                                                                            */
+/******************************************************************************/
+bool LMDBReadTransaction::Get(const std::string& key, boost::string_ref* value) {
+    return Get(mdb_dbi_, key, value);
+}
+
+bool LMDBReadTransaction::Get(MDB_dbi sub_db, const std::string& key, boost::string_ref* value) {
+
+    MDB_val mdb_key, mdb_data;
+
+    mdb_key.mv_size = key.size();
+    mdb_key.mv_data = const_cast<char*>(key.data());
+
+    int get_rc = mdb_get(mdb_txn_, sub_db, &mdb_key, &mdb_data);
+    if (get_rc) {
+        if (get_rc != MDB_NOTFOUND) {
+            LOG(ERROR) << "Txn Get failed: " << mdb_strerror(get_rc);
+        }
         return false;
     }
+    *value = boost::string_ref(static_cast<const char*>(mdb_data.mv_data), mdb_data.mv_size);
     return true;
 }
 
+bool LMDBReadTransaction::GetDatum(const std::string& key, caffe::Datum* datum) {
+    boost::string_ref value;
 
+    if (! Get(key, &value)) {
+        return false;
+    }
+    return datum->ParseFromArray(value.data(), value.size());
+}
+
+LMDBCursor* LMDBReadTransaction::NewCursor() {
+    return NewCursor(mdb_dbi_);
+}
+
+LMDBCursor* LMDBReadTransaction::NewCursor(MDB_dbi sub_db) {
+    MDB_cursor* mdb_cursor;
+
+    if (mdb_cursor_open(mdb_txn_, sub_db, &mdb_cursor)) {
+        return NULL;
+    }
+    return new LMDBCursor(mdb_cursor);
+}
+
+/******************************************************************************/
+/* LMDBCursor                                                                 */
+/*                                                                            */
+/******************************************************************************/
+bool LMDBCursor::SeekToFirst() {
+    return Get(MDB_FIRST);
+}
+
+bool LMDBCursor::Seek(const std::string& key) {
+    mdb_key_.mv_size = key.size();
+    mdb_key_.mv_data = const_cast<char*>(key.data());
+
+    return Get(MDB_SET_RANGE);
+}
+
+bool LMDBCursor::Next() {
+    return Get(MDB_NEXT);
+}
+
+// Compare with the comparison function of the database, so range scans
+// also work with integer keys.
+bool LMDBCursor::Valid() const {
+    if (! valid_ || end_.empty()) {
+        return valid_;
+    }
+    MDB_val mdb_end;
+    mdb_end.mv_size = end_.size();
+    mdb_end.mv_data = const_cast<char*>(end_.data());
+    return mdb_cmp(mdb_cursor_txn(mdb_cursor_), mdb_cursor_dbi(mdb_cursor_), &mdb_key_,
+                   &mdb_end) < 0;
+}
+
+boost::string_ref LMDBCursor::Key() const {
+    return boost::string_ref(static_cast<const char*>(mdb_key_.mv_data), mdb_key_.mv_size);
+}
+
+boost::string_ref LMDBCursor::Value() const {
+    return boost::string_ref(static_cast<const char*>(mdb_value_.mv_data), mdb_value_.mv_size);
+}
+
+// Parse the datum of the current record straight from the memory map.
+bool LMDBCursor::ParseDatum(caffe::Datum* datum) const {
+    return valid_ && datum->ParseFromArray(mdb_value_.mv_data, mdb_value_.mv_size);
+}
+
+bool LMDBCursor::Get(MDB_cursor_op op) {
+    int get_rc = mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_, op);
+
+    valid_ = (get_rc == 0);
+    if (get_rc && get_rc != MDB_NOTFOUND) {
+        LOG(ERROR) << "Cursor Get failed: " << mdb_strerror(get_rc);
+    }
+    return Valid();
+}
@@ -19,6 +19,7 @@
 #include <string>
 #include <vector>
 #include <boost/shared_ptr.hpp>
+#include <boost/utility/string_ref.hpp>
 
 using boost::shared_ptr;
 
@@ -28,10 +29,76 @@ using boost::shared_ptr;
 class LMDBTransaction {
 
 public:
-    LMDBTransaction(MDB_txn* mdb_txn, MDB_dbi mdb_dbi): mdb_txn_(mdb_txn), mdb_dbi_(mdb_dbi) { }
-    bool Put(const std::string& key, const std::string& value);
+    LMDBTransaction(MDB_txn* mdb_txn, MDB_dbi mdb_dbi, bool append = false):
+        mdb_txn_(mdb_txn), mdb_dbi_(mdb_dbi), append_(append), last_rc_(0) { }
+    virtual ~LMDBTransaction() { Abort(); }
+    bool Put(boost::string_ref key, boost::string_ref value);
+    bool PutDatum(const std::string& key, const caffe::Datum& datum);
+    /* Store a value in a named database, see LMDB::OpenSubDatabase. */
+    bool Put(MDB_dbi sub_db, boost::string_ref key, boost::string_ref value);
+    /* Look up a key in a named database, including the changes of this
+       transaction. The value is valid until the next change. */
+    bool Get(MDB_dbi sub_db, const std::string& key, boost::string_ref* value);
+    /* Remove a key, returns true also when the key didn't exist. */
+    bool Delete(const std::string& key);
+    bool Delete(MDB_dbi sub_db, const std::string& key);
     bool Commit();
-    bool CommitAndDoubleMapSize();
+    void Abort();
+    /* True if the last Put or Commit failed because the map is full. The
+       transaction can't be used anymore, abort it and grow the map. */
+    bool MapFull() const { return last_rc_ == MDB_MAP_FULL; }
+
+private:
+    int PutVal(MDB_val *mdb_key, MDB_val *mdb_data, unsigned int flags);
+
+    MDB_txn* mdb_txn_;
+    MDB_dbi mdb_dbi_;
+    bool append_;
+    int last_rc_;
+};
+
+/* Iterates over the records of a read transaction in key order. Keys and
+   values point into the memory map, they are valid until the cursor moves
+   or the transaction ends. */
+class LMDBCursor {
+
+public:
+    LMDBCursor(MDB_cursor* mdb_cursor): mdb_cursor_(mdb_cursor), valid_(false) { }
+    virtual ~LMDBCursor() { mdb_cursor_close(mdb_cursor_); }
+    bool SeekToFirst();
+    /* Move to the first key equal to or larger than key. */
+    bool Seek(const std::string& key);
+    bool Next();
+    /* Stop iterating before end, for range scans. An empty end means no
+       limit. */
+    void SetEnd(const std::string& end) { end_ = end; }
+    bool Valid() const;
+
+    boost::string_ref Key() const;
+    boost::string_ref Value() const;
+    bool ParseDatum(caffe::Datum* datum) const;
+
+private:
+    bool Get(MDB_cursor_op op);
+
+    MDB_cursor* mdb_cursor_;
+    MDB_val mdb_key_, mdb_value_;
+    bool valid_;
+    std::string end_;
+};
+
+class LMDBReadTransaction {
+
+public:
+    LMDBReadTransaction(MDB_txn* mdb_txn, MDB_dbi mdb_dbi): mdb_txn_(mdb_txn), mdb_dbi_(mdb_dbi) { }
+    virtual ~LMDBReadTransaction() { mdb_txn_abort(mdb_txn_); }
+    /* Find the value of key, without copying it out of the memory map. */
+    bool Get(const std::string& key, boost::string_ref* value);
+    bool GetDatum(const std::string& key, caffe::Datum* datum);
+    bool Get(MDB_dbi sub_db, const std::string& key, boost::string_ref* value);
+    /* The cursor must be deleted before the transaction. */
+    LMDBCursor* NewCursor();
+    LMDBCursor* NewCursor(MDB_dbi sub_db);
 
 private:
     MDB_txn* mdb_txn_;
@@ -43,20 +110,56 @@ class LMDB {
 public:
     enum Mode { READ, WRITE, NEW };
 
-    LMDB() : mdb_env_(NULL) { }
+    struct Options {
+        Options() : map_size(0), fast_import(false), max_dbs(0), integer_keys(false) { }
+
+        /* Initial map size, 0 keeps the LMDB default or the size of an
+           existing database. */
+        size_t map_size;
+        /* Don't sync to disk on commit, only when the database is closed. A
+           crash during the import can corrupt the database. */
+        bool fast_import;
+        /* Number of named databases that can be opened next to the main
+           one. */
+        unsigned int max_dbs;
+        /* The keys are size_t integers, compared as numbers. LMDB doesn't
+           allow named databases next to a main database with integer keys,
+           so the records go in the named database RECORDS_DB instead. Caffe
+           can't read such a database. */
+        bool integer_keys;
+    };
+
+    static const char* const RECORDS_DB;
+
+    LMDB() : mdb_env_(NULL), mdb_dbi_(0), read_only_(false), integer_keys_(false),
+             sync_on_close_(false) { }
     virtual ~LMDB() { Close(); }
-    void Open(const std::string& source, Mode mode);
+    void Open(const std::string& source, Mode mode, const Options& options = Options());
     void Close();
+    bool Sync();
 
     bool StoreString(LMDBTransaction *txn, const std::string &key, const std::string &datum_str);
     bool StoreDatum(LMDBTransaction *txn, const std::string &key, const caffe::Datum *  datum);
     bool StoreDatum(const std::string &key, const caffe::Datum * datum);
-    LMDBTransaction* NewTransaction();
+    LMDBTransaction* NewTransaction(bool append = false);
+    LMDBReadTransaction* NewReadTransaction();
     size_t NrOfEntries();
+    size_t MapSize();
+    bool GrowMapSize();
+    /* Open the named database name, or create it if create is set and the
+       environment isn't read-only. flags are extra mdb_dbi_open flags, like
+       MDB_INTEGERKEY. The handle stays valid until Close. */
+    bool OpenSubDatabase(const std::string& name, bool create, MDB_dbi* sub_db,
+                         unsigned int flags = 0);
 
 private:
+    bool OpenDatabase(MDB_txn* mdb_txn, MDB_dbi* mdb_dbi);
+
     MDB_env* mdb_env_;
     MDB_dbi mdb_dbi_;
+    bool read_only_;
+    bool integer_keys_;
+    bool sync_on_close_;
 };
 
 #endif /* lmdb_h */
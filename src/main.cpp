@@ -16,18 +16,22 @@
 // Based on the convert_image_set.cpp program included in the tools section
 // of the Caffe source distribution.
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
 #include <string>
 #include <utility>
+#include <stdint.h>
 #include <vector>
 #include <thread>
+#include <chrono>
+#include <random>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/scoped_ptr.hpp>
-#include <boost/lockfree/spsc_queue.hpp>
-#include <boost/atomic.hpp>
 
 #include "gflags/gflags.h"
 #include "glog/logging.h"
@@ -38,65 +42,177 @@
 #include "caffe/util/db.hpp"
 // #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
-#include "caffe/util/rng.hpp"
 
 #include "lmdb.hpp"
+#include "blocking_queue.hpp"
+#include "commit_policy.hpp"
+#include "image_loader.hpp"
+#include "metadata.hpp"
+#include "db_sync.hpp"
+#include "label_file.hpp"
+#include "read_ahead.hpp"
+#include "image_statistics.hpp"
+#include "record_pool.hpp"
+#include "path_index.hpp"
+#include "pipeline_metrics.hpp"
+#include "image_cache.hpp"
+#include "import_order.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
 using std::vector;
 using boost::shared_ptr;
 using boost::scoped_ptr;
-const char SEPARATOR = ' ';
 
 /* List command-line flags */
 DEFINE_bool(shuffle, false,
             "Randomly shuffle the order of images and their labels");
+DEFINE_bool(shuffle_keys, false,
+            "With --shuffle, read the images in the order of the label file and store "
+            "them under shuffled keys instead. The database has the same random order, "
+            "but the image files are read sequentially");
+DEFINE_int32(shuffle_seed, -1,
+             "Seed of --shuffle, the same seed and label file give the same order. "
+             "-1 picks a random seed, which is logged");
 DEFINE_bool(sync_db, false,
-            "Sync the output database with the list if labels and images");
+            "Sync the existing output database with the list of labels and images: "
+            "import only the images that aren't in the database yet or whose label "
+            "changed, and remove the records of images that are no longer listed. "
+            "Images that changed on disk are only seen with --track_sources");
+DEFINE_bool(track_sources, false,
+            "Record the label, size and modification time of each image in the meta "
+            "folder of the database, so --sync_db also imports changed images again");
+DEFINE_bool(resume, false,
+             "Continue an import that was interrupted, from the last commit. The "
+             "label file and options must be the same as in the interrupted run. "
+             "Not safe after a system crash during a --fast_import, the last "
+             "checkpoints may point past records that never reached the disk");
+DEFINE_bool(integer_keys, false,
+            "Store the records under 8 byte integer keys instead of "
+            "<line number>_<image path>, with an index of the image paths next to "
+            "them. Keeps the database small with long paths, but Caffe can't read it");
+DEFINE_string(partition, "",
+              "Import only part I of N of the label file, as I/N with I from 0 to N-1. "
+              "Each part is a contiguous range of lines, imported with the keys of a "
+              "full import, so merge_lmdb can merge the parts into one database");
+DEFINE_int32(progress_seconds, 10,
+             "Log the progress, rate and expected time left every this many seconds, "
+             "0 to turn it off");
+DEFINE_string(stats_file, "",
+              "Write the metrics of the import to this file as JSON: latencies of each "
+              "stage, busy and waiting time of each thread, queue sizes over time and "
+              "map resizes");
 DEFINE_int32(resize_width, 0, "Width images are resized to");
 DEFINE_int32(resize_height, 0, "Height images are resized to");
+DEFINE_bool(reduced_decode, true,
+            "Decode JPEG images at 1/2, 1/4 or 1/8 scale when they are resized "
+            "to a size that is at least that small");
+DEFINE_bool(encoded, false,
+            "Store the encoded images instead of raw pixels. Images that aren't "
+            "resized or converted are stored as read from disk");
+DEFINE_string(encode_type, "",
+              "Type the images are encoded as ('png','jpg',...), defaults to the "
+              "type of the source image");
+DEFINE_int32(encode_quality, 90, "Quality of re-encoded JPEG images, 0-100");
+DEFINE_int32(commit_megabytes, 256,
+             "Commit when the images stored since the last commit reach this size in MB");
+DEFINE_double(commit_seconds, 10,
+              "Commit at least this often, in seconds");
+DEFINE_double(commit_latency, 2,
+              "Make batches smaller when a commit takes longer than this, in seconds");
+DEFINE_bool(fast_import, false,
+            "Don't sync the database to disk before the import is done. Faster,"
+            " but a crash during the import can leave the database corrupt, and"
+            " then it can't be continued with --resume");
+DEFINE_int32(decode_threads, 1, "Number of threads loading and decoding images");
+DEFINE_bool(compute_mean, false,
+            "Compute the mean image of the imported images while importing them and "
+            "store it in DB_NAME.mean.binaryproto, as compute_image_mean does. Also "
+            "logs the mean and standard deviation of each channel");
+DEFINE_string(image_cache, "",
+              "Keep the loaded images in an LMDB database in this folder, shared "
+              "between imports, so images imported before with the same options "
+              "aren't read and decoded again");
+DEFINE_int32(image_cache_gigabytes, 64,
+             "Maximum size of the --image_cache in GB, the cache stops growing at this "
+             "size");
+DEFINE_int32(io_threads, 0,
+             "Number of threads reading image files ahead of the reader threads, "
+             "0 lets the reader threads read the files themselves");
+DEFINE_int32(read_ahead, 64,
+             "Maximum number of image files read ahead of the reader threads, with "
+             "--io_threads");
+DEFINE_int32(shards, 1,
+             "Spread the images round-robin over this many databases DB_NAME_00, "
+             "DB_NAME_01, ..., each with its own writer thread. The image at position "
+             "p of the import goes to database p % shards");
+DEFINE_int32(queue_capacity, 128,
+             "Maximum number of images waiting to be written to the database");
+DEFINE_int32(queue_megabytes, 256,
+             "Maximum size in MB of the images waiting to be written to the database");
 
-/* Read a file if <image path><sep><label> pairs, where sep = SEPARATOR. */
-std::vector<std::pair<std::string, int> > read_image_labels(const std::string& path) {
-    std::ifstream infile(path);
-    std::vector<std::pair<std::string, int> > lines;
-    std::string line;
-    size_t pos;
-    int label;
+/* The options that change the contents of the databases, stored with the
+   checkpoints of an import. */
+std::string import_settings(const std::string& root_folder, const ImageOptions& image_options,
+                            size_t nr_of_shards) {
+    std::ostringstream settings;
 
-    while (std::getline(infile, line)) {
-        pos = line.find_last_of(SEPARATOR);
-        label = atoi(line.substr(pos + 1).c_str());
-        lines.push_back(std::make_pair(line.substr(0, pos), label));
+    settings << "root_folder=" << root_folder
+             << " resize=" << image_options.resize_width << "x" << image_options.resize_height
+             << " reduced_decode=" << image_options.reduced_decode
+             << " encoded=" << image_options.encoded
+             << " encode_type=" << image_options.encode_type
+             << " encode_quality=" << image_options.encode_quality
+             << " shards=" << nr_of_shards;
+    if (! FLAGS_partition.empty()) {
+        settings << " partition=" << FLAGS_partition;
+    }
+    if (FLAGS_shuffle) {
+        settings << " shuffle=" << (FLAGS_shuffle_keys ? "keys" : "lines")
+                 << " shuffle_seed=" << FLAGS_shuffle_seed;
     }
+    if (FLAGS_integer_keys) {
+        settings << " integer_keys=1";
+    }
+    return settings.str();
+}
+
+/* Merge the statistics of the readers, store the mean image in
+   DB_NAME.mean.binaryproto and log the statistics of each channel. */
+void write_image_statistics(const std::string& db_name,
+                            const vector<shared_ptr<ImageStatistics> >& reader_statistics) {
+    ImageStatistics statistics;
 
-    return lines;
+    for (size_t i = 0; i < reader_statistics.size(); ++i) {
+        statistics.Merge(*reader_statistics[i]);
+    }
+    if (statistics.HasMeanImage()) {
+        BlobProto mean;
+        statistics.MeanImage(&mean);
+        WriteProtoToBinaryFile(mean, db_name + ".mean.binaryproto");
+        LOG(INFO) << "Wrote the mean of " << statistics.NrOfImages() << " images to "
+                  << db_name << ".mean.binaryproto.";
+    } else if (statistics.NrOfImages() > 0) {
+        LOG(WARNING) << "The images have different sizes, no mean image.";
+    }
+    for (int c = 0; c < statistics.Channels(); ++c) {
+        LOG(INFO) << "Channel " << c << ": mean " << statistics.ChannelMean(c)
+                  << ", std " << statistics.ChannelStd(c) << ".";
+    }
 }
 
 // Open an existing database of create a new one.
-LMDB* open_or_create_db(const std::string& source, bool sync_db) {
+LMDB* open_or_create_db(const std::string& source, bool existing, const LMDB::Options& options) {
     LMDB* db(new LMDB());
-    if (sync_db) {
-        db->Open(source, LMDB::WRITE);
+    if (existing) {
+        db->Open(source, LMDB::WRITE, options);
     } else {
-        db->Open(source, LMDB::NEW);
+        db->Open(source, LMDB::NEW, options);
     }
 
     return db;
 }
 
-shared_ptr<Datum> load_image(const std::string& source, int label, const int resize_width, const int resize_height) {
-    bool status;
-    shared_ptr<Datum> datum(new Datum());
-
-    bool is_color = true;
-    string encode_type = "";
-    status = ReadImageToDatum(source, label, resize_height, resize_width, is_color,
-                              encode_type, datum.get());
-    return datum;
-}
-
 const std::string path_join(const std::string &path1, const std::string &path2) {
 
     boost::filesystem::path full_path (path1);
@@ -106,106 +222,586 @@ const std::string path_join(const std::string &path1, const std::string &path2)
     return full_path.string();
 }
 
-/* A lock-free queue, used to pass the read <key> <datum> pairs from the 
-   reader thread to the writer thread */
-boost::lockfree::spsc_queue< pair<std::string, std::string> > queue(128);
-boost::atomic<bool> done_writing (false);
+/* Same as path_join, in full_path, reusing its buffer. */
+void path_join(const std::string& path1, boost::string_ref path2, std::string* full_path) {
+    full_path->assign(path1);
+    if (! full_path->empty() && (*full_path)[full_path->size() - 1] != '/' &&
+        ! path2.empty() && path2[0] != '/') {
+        full_path->push_back('/');
+    }
+    full_path->append(path2.data(), path2.size());
+}
+
+/* Estimate the size of the database for nr_of_images images, so the map
+   doesn't have to grow during the import. Key sizes are taken from samples,
+   lines spread over the label file. Without resize parameters, the image
+   size is taken from the sampled images too. The same goes for encoded
+   images. */
+size_t estimate_map_size(const vector<pair<std::string, int> >& samples, size_t nr_of_images,
+                         const std::string& root_folder, const ImageOptions& image_options) {
+    const size_t page_size = 4096;
+    const size_t nr_of_samples = samples.size();
+    size_t datum_size = 0, key_size = 0;
 
-class ReaderThread {
+    if (nr_of_samples == 0 || nr_of_images == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < nr_of_samples; ++i) {
+        key_size += 9 + samples[i].first.size();
+    }
+    key_size /= nr_of_samples;
+
+    // With integer keys the image path is stored twice in the index instead.
+    size_t index_size = 0;
+    if (FLAGS_integer_keys) {
+        index_size = 2 * (key_size - 9 + sizeof(size_t) + 16) * 3 / 2;
+        key_size = sizeof(size_t);
+    }
+
+    if (image_options.resize_width > 0 && image_options.resize_height > 0 &&
+        ! image_options.encoded) {
+        // Pixel data plus a few bytes for the other Datum fields.
+        datum_size = (size_t)image_options.resize_width * image_options.resize_height * 3 + 32;
+    } else {
+        size_t loaded = 0;
+        for (size_t i = 0; i < nr_of_samples; ++i) {
+            const pair<std::string, int>& line = samples[i];
+            shared_ptr<Datum> datum = load_image(path_join(root_folder, line.first),
+                                                 line.second, image_options);
+            if (datum) {
+                datum_size += datum->ByteSizeLong();
+                loaded ++;
+            }
+        }
+        if (loaded == 0) {
+            return 0;
+        }
+        datum_size /= loaded;
+    }
+
+    // Large records are stored on their own overflow pages, small ones share
+    // leaf pages that are never completely full.
+    size_t record_size = key_size + datum_size + 16;
+    if (record_size > page_size / 2) {
+        record_size = (record_size + page_size - 1) / page_size * page_size;
+    } else {
+        record_size = record_size * 3 / 2;
+    }
+
+    // Leave 25% headroom for the branch pages and the free list.
+    size_t map_size = nr_of_images * (record_size + index_size) / 4 * 5;
+    return (map_size / page_size + 1) * page_size;
+}
+
+/* A blocking queue, used to pass the records with the read <key> <datum>
+   from one reader thread to one writer thread. The reader closes its queues
+   when it has pushed all of its images. The writer returns the records to
+   the record pool when they are committed. */
+typedef BlockingQueue<shared_ptr<Record> > DatumQueue;
+
+/* A line of the label file for a reader: its position in the order of the
+   import and the number of the line in its key. The image path points into
+   the label file, which stays open during the import. With read-ahead, file
+   is the image file being read. */
+struct LabelLine {
+    size_t position;
+    size_t line_number;
+    boost::string_ref image_path;
+    int label;
+    shared_ptr<FileRead> file;
+};
+typedef BlockingQueue<LabelLine> LineQueue;
+
+/* Parses the label file while the images are imported. With N reader
+   threads, the line at position l of the import goes to reader l % N. The
+   lines are imported in file order, or in the order of offsets when given.
+   The key of a line holds its position, or its number in line_numbers.
+   Lines that the writer of their shard committed before an interruption are
+   skipped. With a read_ahead pool, the parser starts reading the image files
+   of the lines it hands out, except those found in the image cache. */
+class ParserThread {
 public:
-    ReaderThread(vector<pair<std::string, int> > image_label_lines,
-                 std::string root_folder, int resize_width, int resize_height) :
-                    image_label_lines_(image_label_lines),
-                    root_folder_(root_folder), resize_width_(resize_width),
-                    resize_height_(resize_height) { }
+    ParserThread(shared_ptr<const LabelFile> label_file,
+                 shared_ptr<const vector<uint64_t> > offsets,
+                 shared_ptr<const vector<size_t> > line_numbers,
+                 const vector<size_t>& resume_lines, vector<shared_ptr<LineQueue> > queues,
+                 const ImportRouting& routing, std::string root_folder,
+                 shared_ptr<ReadAhead> read_ahead, shared_ptr<PipelineMetrics> metrics,
+                 shared_ptr<ImageCache> cache) :
+                    label_file_(label_file), offsets_(offsets), line_numbers_(line_numbers),
+                    resume_lines_(resume_lines), queues_(queues), routing_(routing),
+                    root_folder_(root_folder),
+                    read_ahead_(read_ahead), metrics_(metrics), cache_(cache), thread_(NULL) { }
 
     void operator()() {
-        LOG(INFO) << "Starting to import " << image_label_lines_.size() << " files.";
+        boost::string_ref image_path;
+        int label;
 
-        for (int line_id = 0; line_id < image_label_lines_.size(); ++line_id) {
-            std::string image_path = image_label_lines_[line_id].first;
-            int image_label = image_label_lines_[line_id].second;
-            std::string full_path = path_join(root_folder_, image_path);
+        thread_ = metrics_->AddThread("parser");
 
-            //        std::cout << "Image - label: " << std::to_string(image_label) << "\n";
-            //        std::cout << "Path: " << full_path << "\n";
+        if (offsets_) {
+            for (size_t position = 0; position < offsets_->size(); ++position) {
+                label_file_->LineAt((*offsets_)[position], &image_path, &label);
+                if (! dispatch(position, image_path, label)) {
+                    break;
+                }
+            }
+        } else {
+            uint64_t offset = 0;
+            for (size_t position = 0; label_file_->NextLine(&offset, &image_path, &label);
+                 ++position) {
+                if (! dispatch(position, image_path, label)) {
+                    break;
+                }
+            }
+        }
+        for (size_t i = 0; i < queues_.size(); ++i) {
+            queues_[i]->Close();
+        }
+        thread_->Busy(watch_.Lap());
+    }
 
-            std::string key = caffe::format_int(line_id, 8) + "_" + image_path;
+private:
+    bool dispatch(size_t position, boost::string_ref image_path, int label) {
+        if (position < resume_lines_[routing_.Shard(position)]) {
+            return true;
+        }
+        LabelLine line;
+        line.position = position;
+        line.line_number = line_numbers_ ? (*line_numbers_)[position] : position;
+        line.image_path = image_path;
+        line.label = label;
+        if (read_ahead_ && ! image_path.empty()) {
+            std::string full_path = path_join(root_folder_, image_path.to_string());
+            bool cached = cache_ && cache_->Key(full_path, &cache_key_) &&
+                          cache_->Contains(cache_key_);
+            if (! cached) {
+                line.file = read_ahead_->Read(full_path);
+            }
+        }
+        size_t bytes = line.image_path.size();
+        thread_->Busy(watch_.Lap());
+        bool pushed = queues_[routing_.Reader(position)]->Push(std::move(line), bytes);
+        thread_->Idle(watch_.Lap());
+        return pushed;
+    }
+
+    shared_ptr<const LabelFile> label_file_;
+    shared_ptr<const vector<uint64_t> > offsets_;
+    shared_ptr<const vector<size_t> > line_numbers_;
+    vector<size_t> resume_lines_;
+    vector<shared_ptr<LineQueue> > queues_;
+    ImportRouting routing_;
+    std::string root_folder_;
+    shared_ptr<ReadAhead> read_ahead_;
+    shared_ptr<PipelineMetrics> metrics_;
+    shared_ptr<ImageCache> cache_;
+    std::string cache_key_;
+    ThreadMetrics* thread_;
+    Stopwatch watch_;
+};
 
-            shared_ptr<caffe::Datum> datum = load_image(full_path, image_label, resize_width_, resize_height_);
+/* Loads images. With N reader threads, reader i handles lines
+   i, i + N, i + 2N, ... so a writer can restore the order of the label file
+   by taking one datum from each reader in turn. With S shards, line l goes to
+   the writer of shard l % S, through a queue per reader and shard. Each
+   reader adds its images to its own image_statistics, if any. The records
+   and the file buffer are reused from image to image. */
+class ReaderThread {
+public:
+    ReaderThread(shared_ptr<LineQueue> lines, std::string root_folder,
+                 const ImageOptions& image_options, shared_ptr<LoadStatistics> stats,
+                 vector<shared_ptr<DatumQueue> > queues, const ImportRouting& routing,
+                 shared_ptr<RecordPool> pool, shared_ptr<ImageStatistics> image_statistics,
+                 shared_ptr<PipelineMetrics> metrics, const std::string& name,
+                 shared_ptr<ImageCache> cache) :
+                    lines_(lines), root_folder_(root_folder), image_options_(image_options),
+                    stats_(stats), queues_(queues), routing_(routing), pool_(pool),
+                    image_statistics_(image_statistics), metrics_(metrics), name_(name),
+                    cache_(cache) { }
+
+    void operator()() {
+        LabelLine line;
+        std::string full_path;
+        vector<unsigned char> buffer;
+        std::string cache_key;
+        ThreadMetrics* thread = metrics_->AddThread(name_);
+        Stopwatch watch;
+
+        while (next_line(line, thread, watch)) {
+            Stopwatch stage;
+            path_join(root_folder_, line.image_path, &full_path);
+            shared_ptr<Record> record = pool_->Get();
+            line_key(line.line_number, line.image_path, FLAGS_integer_keys, &record->key);
+            if (FLAGS_integer_keys) {
+                record->image_path.assign(line.image_path.data(), line.image_path.size());
+            }
 
-            std::string datum_str;
-            if (datum->SerializeToString(&datum_str)) {
-                // push key, Datum in the queue
-                while (!queue.push(std::make_pair(key, datum_str)))
-                    ;
+            // Cached images don't need to be read or decoded.
+            bool cacheable = cache_ && ! line.image_path.empty() &&
+                             cache_->Key(full_path, &cache_key);
+            if (line.image_path.empty()) {
+                // An empty line keeps its line number, but has no image.
+                LOG(WARNING) << "Skipping an empty line in the label file.";
+            } else if (cacheable && cache_->Get(cache_key, line.label, &record->datum)) {
+                record->loaded = true;
+                stats_->images ++;
+                stats_->bytes_out += record->datum.ByteSizeLong();
+                metrics_->AddLatency(PipelineMetrics::READ, stage.Lap());
+            } else {
+                load(line, full_path, buffer, record.get(), stage);
+                if (record->loaded && cacheable) {
+                    cache_->Put(cache_key, record->datum);
+                }
+            }
+            // Let the next file be read.
+            line.file.reset();
+            if (record->loaded && image_statistics_) {
+                image_statistics_->Add(record->datum);
             }
 
-            if ((line_id + 1) % 10000 == 0) {
+            // push the record in the queue, also for failed images so the
+            // writer stays in step with this reader. The writer serializes
+            // the datum straight into the database.
+            size_t bytes = record->key.size() + record->image_path.size() +
+                           (record->loaded ? record->datum.ByteSizeLong() : 0);
+            shared_ptr<DatumQueue> queue = queues_[routing_.Shard(line.position)];
+            thread->Busy(watch.Lap());
+            bool pushed = queue->Push(std::move(record), bytes);
+            thread->Idle(watch.Lap());
+            if (! pushed) {
                 break;
             }
         }
-        done_writing = true;
+        for (size_t i = 0; i < queues_.size(); ++i) {
+            queues_[i]->Close();
+        }
+        thread->Busy(watch.Lap());
     }
 private:
-    std::vector<std::pair<std::string, int> > image_label_lines_;
+    /* Read and decode the image of line in record. */
+    void load(const LabelLine& line, const std::string& full_path,
+              vector<unsigned char>& buffer, Record* record, Stopwatch& stage) {
+        // With read-ahead, reading is the time waiting for the file.
+        const vector<unsigned char>* contents = NULL;
+        if (! line.file) {
+            contents = read_file(full_path, &buffer) ? &buffer : NULL;
+        } else if (line.file->Wait()) {
+            contents = &line.file->Contents();
+        }
+        metrics_->AddLatency(PipelineMetrics::READ, stage.Lap());
+        if (contents) {
+            record->loaded = load_image(full_path, *contents, line.label, image_options_,
+                                        &record->datum, stats_.get());
+            metrics_->AddLatency(PipelineMetrics::DECODE, stage.Lap());
+        } else {
+            LOG(WARNING) << "Could not load image " << full_path;
+        }
+    }
+
+    bool next_line(LabelLine& line, ThreadMetrics* thread, Stopwatch& watch) {
+        thread->Busy(watch.Lap());
+        bool popped = lines_->Pop(line);
+        thread->Idle(watch.Lap());
+        return popped;
+    }
+
+    shared_ptr<LineQueue> lines_;
     std::string root_folder_;
-    int resize_height_;
-    int resize_width_;
+    ImageOptions image_options_;
+    shared_ptr<LoadStatistics> stats_;
+    vector<shared_ptr<DatumQueue> > queues_;
+    ImportRouting routing_;
+    shared_ptr<RecordPool> pool_;
+    shared_ptr<ImageStatistics> image_statistics_;
+    shared_ptr<PipelineMetrics> metrics_;
+    std::string name_;
+    shared_ptr<ImageCache> cache_;
 };
 
+/* Stores the lines shard, shard + S, shard + 2S, ... in one database, where
+   S is the number of shards, starting at checkpoint.next_line. When syncing
+   an existing database, the records in delete_keys are removed first.
+   Otherwise a checkpoint is stored after each commit, so an interrupted
+   import can be resumed. Records go back to the pool once committed. */
 class WriterThread {
 public:
-    WriterThread(std::string db_name): db_name_(db_name), db_(NULL) { }
+    WriterThread(std::string db_name, size_t shard, const ImportRouting& routing,
+                 vector<shared_ptr<DatumQueue> > queues, shared_ptr<RecordPool> pool,
+                 size_t map_size, const CommitPolicy& commit_policy, std::string root_folder,
+                 const vector<std::string>& delete_keys, const Checkpoint& checkpoint,
+                 bool existing, shared_ptr<PipelineMetrics> metrics):
+        db_name_(db_name), shard_(shard), routing_(routing), queues_(queues),
+        pool_(pool), commit_policy_(commit_policy), map_size_(map_size), db_(NULL),
+        root_folder_(root_folder), delete_keys_(delete_keys), track_sources_(false),
+        append_(true), checkpoint_(checkpoint), checkpoints_(! FLAGS_sync_db),
+        existing_(existing), metrics_(metrics), thread_(NULL) { }
 
     void operator()() {
-        db_ = open_or_create_db(db_name_, FLAGS_sync_db);
+        thread_ = metrics_->AddThread("writer " + caffe::format_int(shard_));
+        LMDB::Options options;
+        options.map_size = map_size_;
+        options.fast_import = FLAGS_fast_import;
+        options.integer_keys = FLAGS_integer_keys;
+        options.max_dbs = FLAGS_integer_keys ? 2 : 0;
+        db_ = open_or_create_db(db_name_, existing_, options);
+        if (FLAGS_integer_keys && ! path_index_.Open(db_, true)) {
+            LOG(FATAL) << "Error opening the image path index of " << db_name_ << ".";
+        }
+        metadata_.reset(new Metadata());
+        bool has_metadata = metadata_->Open(db_name_, FLAGS_track_sources || checkpoints_,
+                                            FLAGS_fast_import);
+        track_sources_ = has_metadata && (FLAGS_track_sources || metadata_->HasSources());
+        if (! delete_keys_.empty()) {
+            delete_records();
+        }
 
         size_t id = 0;
-        scoped_ptr<LMDBTransaction> txn(db_->NewTransaction());
+        // Keys start with the line number, so they arrive in increasing order.
+        // New records of a synced database go in between the existing ones,
+        // shuffled keys arrive in random order.
+        append_ = ! FLAGS_sync_db && ! FLAGS_shuffle_keys;
+        scoped_ptr<LMDBTransaction> txn(db_->NewTransaction(append_));
+        shared_ptr<Record> record;
 
-        while (! done_writing) {
-            std::this_thread::yield();
-            store_all_on_queue(txn, id, false);
+        for (size_t line_id = checkpoint_.next_line; next_from_readers(line_id, record);
+             line_id = routing_.NextInShard(line_id)) {
+            id ++;
+            checkpoint_.next_line = routing_.NextInShard(line_id);
+            if (! record->loaded) {
+                metrics_->AddImage(0);
+                pool_->Put(std::move(record));
+                continue;
+            }
+
+            size_t bytes = record->key.size() + record->datum.ByteSizeLong();
+            metrics_->AddImage(bytes);
+            store(txn, std::move(record));
+            if (commit_policy_.Add(bytes)) {
+                commit(txn);
+                LOG(INFO) << "Committing. Processed " << id << " files.";
+            }
         }
 
-        store_all_on_queue(txn, id, true);
+        // Commit the last batch, if any.
+        commit(txn);
+        LOG(INFO) << "Committing. Processed " << id << " files (and last) in " << db_name_ << ".";
+        LOG(INFO) << "Made " << commit_policy_.NrOfCommits() << " commits of "
+                  << commit_policy_.MinBatchSize() << " to " << commit_policy_.MaxBatchSize()
+                  << " records, final batch size " << commit_policy_.BatchSize() << ".";
+        thread_->Busy(watch_.Lap());
     }
 
-    void store_all_on_queue(scoped_ptr<LMDBTransaction>& txn, size_t& id, bool last) {
-        pair<std::string, std::string> value;
-
+    /* Store the datum in the transaction. The datum is kept until the
+       transaction is committed, so the whole batch can be stored again when
+       the map turns out to be full. */
+    void store(scoped_ptr<LMDBTransaction>& txn, shared_ptr<Record> record) {
+        batch_.push_back(std::move(record));
+        const Record& stored = *batch_.back();
+        Stopwatch put;
+        if (put_record(txn, stored)) {
+            metrics_->AddLatency(PipelineMetrics::PUT, put.Lap());
+            return;
+        }
+        if (txn->MapFull()) {
+            grow_map_and_store_batch(txn);
+        } else {
+            LOG(ERROR) << "Error storing datum " << stored.key << " in db.";
+            pool_->Put(std::move(batch_.back()));
+            batch_.pop_back();
+        }
+    }
 
-        while (queue.pop(value)) {
+    void commit(scoped_ptr<LMDBTransaction>& txn) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-            bool success = db_->StoreString(txn.get(), value.first, value.second);
-            if (! success) {
-                // TODO: handle specific exception.
-                txn->CommitAndDoubleMapSize();
-                txn.reset(db_->NewTransaction());
-                LOG(ERROR) << "Error storing datum in db. Doubling map size!";
+        bool committed = true;
+        while (! txn->Commit()) {
+            if (! txn->MapFull()) {
+                LOG(ERROR) << "Error committing, lost " << batch_.size() << " files.";
+                committed = false;
                 break;
+            }
+            grow_map_and_store_batch(txn);
+        }
+        if (committed && (track_sources_ || checkpoints_)) {
+            store_progress();
+        }
+        for (size_t i = 0; i < batch_.size(); ++i) {
+            pool_->Put(std::move(batch_[i]));
+        }
+        batch_.clear();
+        txn.reset(db_->NewTransaction(append_));
+
+        std::chrono::duration<double> commit_time = std::chrono::steady_clock::now() - start;
+        commit_policy_.Committed(commit_time.count());
+        metrics_->AddLatency(PipelineMetrics::COMMIT, commit_time.count());
+    }
 
+    /* Drop the failed transaction, grow the map and store the batch in a new
+       transaction. Repeat until the batch fits. */
+    void grow_map_and_store_batch(scoped_ptr<LMDBTransaction>& txn) {
+        bool stored = false;
+
+        while (! stored) {
+            txn->Abort();
+            if (! db_->GrowMapSize()) {
+                LOG(FATAL) << "Error growing the map size of the db.";
             }
-            id ++;
-            if ((id > 0) && (id % 1000 == 0)) {
-                txn->Commit();
-                txn.reset(db_->NewTransaction());
-                LOG(INFO) << "Committing. Processed " << id << " files.";
+            metrics_->AddMapResize(db_->MapSize());
+            txn.reset(db_->NewTransaction(append_));
+
+            stored = true;
+            for (size_t i = 0; i < batch_.size() && stored; ) {
+                if (put_record(txn, *batch_[i])) {
+                    ++i;
+                } else if (txn->MapFull()) {
+                    stored = false;
+                } else {
+                    // Like store, drop the record that can't be stored.
+                    LOG(ERROR) << "Error storing datum " << batch_[i]->key << " in db.";
+                    pool_->Put(std::move(batch_[i]));
+                    batch_.erase(batch_.begin() + i);
+                }
+            }
+        }
+    }
+
+    /* Store the datum of record, and with integer keys its image path in the
+       index. */
+    bool put_record(scoped_ptr<LMDBTransaction>& txn, const Record& record) {
+        if (! txn->PutDatum(record.key, record.datum)) {
+            return false;
+        }
+        return ! FLAGS_integer_keys || path_index_.Put(txn.get(), record.key, record.image_path);
+    }
+
+    /* Record where the images of the committed batch came from and how far
+       the import got. The metadata is committed after the records, if the
+       import stops in between the records of the batch are imported again
+       under the same keys when it resumes. */
+    void store_progress() {
+        vector<pair<std::string, SourceInfo> > sources;
+
+        for (size_t i = 0; i < batch_.size() && track_sources_; ++i) {
+            SourceInfo info;
+            std::string image_path = key_image_path(batch_[i]->key).to_string();
+            if (read_source_info(path_join(root_folder_, image_path), batch_[i]->datum.label(),
+                                 &info)) {
+                sources.push_back(std::make_pair(batch_[i]->key, info));
             }
+        }
+        if (checkpoints_ && ! metadata_->PutCheckpoint(checkpoint_, sources)) {
+            LOG(ERROR) << "Error storing the checkpoint at line " << checkpoint_.next_line << ".";
+        }
+        if (! checkpoints_ && ! metadata_->PutSources(sources)) {
+            LOG(ERROR) << "Error storing the sources of " << sources.size() << " files.";
+        }
+    }
 
-            // Commit the last batch, if any.
-            if (last && (id % 1000 > 0)) {
-                txn->Commit();
-                LOG(INFO) << "Committing. Processed " << id << " files (and last).";
+    /* Remove the records of images that were removed from the label file or
+       changed, in one transaction. */
+    void delete_records() {
+        scoped_ptr<LMDBTransaction> txn;
+        bool deleted = false;
+
+        while (! deleted) {
+            txn.reset(db_->NewTransaction());
+            deleted = true;
+            for (size_t i = 0; i < delete_keys_.size() && deleted; ++i) {
+                deleted = txn->Delete(delete_keys_[i]);
+            }
+            deleted = deleted && txn->Commit();
+            if (! deleted) {
+                if (! txn->MapFull()) {
+                    LOG(FATAL) << "Error removing records from " << db_name_ << ".";
+                }
+                txn->Abort();
+                if (! db_->GrowMapSize()) {
+                    LOG(FATAL) << "Error growing the map size of the db.";
+                }
+                metrics_->AddMapResize(db_->MapSize());
             }
-//            LOG(INFO) << " available on queue: " << queue.read_available();
         }
+        if (track_sources_ && ! metadata_->DeleteSources(delete_keys_)) {
+            LOG(ERROR) << "Error removing the sources of " << delete_keys_.size() << " files.";
+        }
+        LOG(INFO) << "Removed " << delete_keys_.size() << " records from " << db_name_ << ".";
+    }
+
+    /* Take the datum for line_id from the reader that handles it. Returns
+       false when that reader has finished, which means all lines are done. */
+    bool next_from_readers(size_t line_id, shared_ptr<Record>& record) {
+        thread_->Busy(watch_.Lap());
+        bool popped = queues_[routing_.Reader(line_id)]->Pop(record);
+        thread_->Idle(watch_.Lap());
+        return popped;
     }
+
     virtual ~WriterThread() { if (db_) delete db_; db_ = NULL; }
 private:
     std::string db_name_;
+    size_t shard_;
+    ImportRouting routing_;
+    vector<shared_ptr<DatumQueue> > queues_;
+    shared_ptr<RecordPool> pool_;
+    vector<shared_ptr<Record> > batch_;
+    CommitPolicy commit_policy_;
+    size_t map_size_;
     LMDB* db_;
+    PathIndex path_index_;
+    std::string root_folder_;
+    vector<std::string> delete_keys_;
+    shared_ptr<Metadata> metadata_;
+    bool track_sources_;
+    bool append_;
+    Checkpoint checkpoint_;
+    bool checkpoints_;
+    bool existing_;
+    shared_ptr<PipelineMetrics> metrics_;
+    ThreadMetrics* thread_;
+    Stopwatch watch_;
+};
+
+/* Samples how full the queues are every second and logs the progress every
+   progress_seconds, until the metrics are stopped. */
+class ProgressThread {
+public:
+    ProgressThread(shared_ptr<PipelineMetrics> metrics,
+                   vector<shared_ptr<LineQueue> > line_queues,
+                   vector<shared_ptr<DatumQueue> > datum_queues, double progress_seconds) :
+                    metrics_(metrics), line_queues_(line_queues), datum_queues_(datum_queues),
+                    progress_seconds_(progress_seconds) { }
+
+    void operator()() {
+        double interval = progress_seconds_ > 0 ? std::min(1.0, progress_seconds_) : 1.0;
+        double since_progress = 0;
+        Stopwatch watch;
+
+        while (! metrics_->WaitForStop(interval)) {
+            size_t line_items = 0, datum_items = 0, datum_bytes = 0;
+            for (size_t i = 0; i < line_queues_.size(); ++i) {
+                line_items += line_queues_[i]->Size();
+            }
+            for (size_t i = 0; i < datum_queues_.size(); ++i) {
+                datum_items += datum_queues_[i]->Size();
+                datum_bytes += datum_queues_[i]->Bytes();
+            }
+            metrics_->AddQueueSample(line_items, datum_items, datum_bytes);
+
+            since_progress += watch.Lap();
+            if (progress_seconds_ > 0 && since_progress >= progress_seconds_) {
+                LOG(INFO) << metrics_->Progress();
+                since_progress = 0;
+            }
+        }
+    }
+
+private:
+    shared_ptr<PipelineMetrics> metrics_;
+    vector<shared_ptr<LineQueue> > line_queues_;
+    vector<shared_ptr<DatumQueue> > datum_queues_;
+    double progress_seconds_;
 };
 
 // this should take a const char * argv[], but ParseCommandLineFlags wants
@@ -235,28 +831,279 @@ int main(int argc, char * argv[]) {
     std::string image_labels_file(argv[2]);
     std::string db_name(argv[3]);
 
-    // Read LABEL_FILE (= the file maps image paths to labels).
-    vector<pair<std::string, int> > image_label_lines;
-    image_label_lines = read_image_labels(image_labels_file);
+    // LABEL_FILE maps image paths to labels. It is parsed during the import,
+    // only shuffling needs an index of all lines up front.
+    shared_ptr<LabelFile> label_file(new LabelFile());
+    label_file->Open(image_labels_file);
+    size_t nr_of_lines = label_file->CountLines();
+    shared_ptr<vector<uint64_t> > offsets;
+    shared_ptr<vector<size_t> > line_numbers;
 
+    if (FLAGS_shuffle_keys && ! FLAGS_shuffle) {
+        LOG(FATAL) << "--shuffle_keys needs --shuffle.";
+    }
+    if (FLAGS_shuffle && FLAGS_sync_db) {
+        LOG(FATAL) << "--shuffle can't be combined with --sync_db.";
+    }
+    ImportOrderOptions order_options;
     if (FLAGS_shuffle) {
-        // randomly shuffle data
-        LOG(INFO) << "Shuffling data";
-        shuffle(image_label_lines.begin(), image_label_lines.end());
+        if (FLAGS_shuffle_seed < 0) {
+            if (FLAGS_resume || ! FLAGS_partition.empty()) {
+                LOG(FATAL) << "--shuffle with --resume or --partition needs --shuffle_seed.";
+            }
+            // Stored with the checkpoints, so the import can be resumed.
+            FLAGS_shuffle_seed = std::random_device()() & INT32_MAX;
+        }
+        LOG(INFO) << "Shuffling data with seed " << FLAGS_shuffle_seed
+                  << (FLAGS_shuffle_keys ? ", reading the images in file order" : "");
+        order_options.shuffle = true;
+        order_options.shuffle_keys = FLAGS_shuffle_keys;
+        order_options.shuffle_seed = FLAGS_shuffle_seed;
+    }
+    if (! FLAGS_partition.empty()) {
+        if (! parse_partition(FLAGS_partition, &order_options.part, &order_options.nr_of_parts)) {
+            LOG(FATAL) << "--partition must be I/N, with I from 0 to N-1.";
+        }
+        // The shards are filled by position in the import, which starts at 0
+        // in each part, so a part would spread its lines differently than
+        // a full import.
+        if (FLAGS_sync_db || FLAGS_shards > 1) {
+            LOG(FATAL) << "--partition can't be combined with --sync_db or --shards.";
+        }
+    }
+    if (order_options.shuffle || order_options.nr_of_parts > 1) {
+        vector<uint64_t> all_offsets;
+        label_file->BuildIndex(&all_offsets);
+        offsets.reset(new vector<uint64_t>());
+        line_numbers.reset(new vector<size_t>());
+        import_order(all_offsets, order_options, offsets.get(), line_numbers.get());
+        if (order_options.nr_of_parts > 1) {
+            LOG(INFO) << "Importing part " << order_options.part << " of "
+                      << order_options.nr_of_parts << ": " << offsets->size() << " of "
+                      << nr_of_lines << " lines.";
+        }
+        nr_of_lines = offsets->size();
     }
-    int resize_height = std::max<int>(0, FLAGS_resize_height);
-    int resize_width  = std::max<int>(0, FLAGS_resize_width);
+    ImageOptions image_options;
+    image_options.resize_height = std::max<int>(0, FLAGS_resize_height);
+    image_options.resize_width  = std::max<int>(0, FLAGS_resize_width);
+    image_options.reduced_decode = FLAGS_reduced_decode;
+    image_options.encoded = FLAGS_encoded;
+    image_options.encode_type = FLAGS_encode_type;
+    image_options.encode_quality = FLAGS_encode_quality;
+    shared_ptr<LoadStatistics> stats(new LoadStatistics());
+    size_t decode_threads = std::max<int>(1, FLAGS_decode_threads);
+    size_t nr_of_shards = std::max<int>(1, FLAGS_shards);
 
-    ReaderThread rt(image_label_lines, root_folder, resize_width, resize_height);
-    std::thread reader(rt);
-    WriterThread wt(db_name);
-    std::thread writer(wt);
+    vector<std::string> shard_names;
+    for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+        shard_names.push_back(nr_of_shards == 1 ? db_name : shard_name(db_name, shard));
+    }
+
+    // Continue where each writer committed its last batch.
+    Checkpoint checkpoint;
+    // A sync doesn't write checkpoints.
+    checkpoint.label_hash = FLAGS_sync_db ? 0 : label_file->Hash();
+    checkpoint.settings = import_settings(root_folder, image_options, nr_of_shards);
+    vector<Checkpoint> checkpoints(nr_of_shards, checkpoint);
+    vector<size_t> resume_lines(nr_of_shards, 0);
+    vector<bool> existing(nr_of_shards, FLAGS_sync_db);
+    if (FLAGS_integer_keys && (FLAGS_sync_db || FLAGS_track_sources)) {
+        LOG(FATAL) << "--integer_keys can't be combined with --sync_db or --track_sources.";
+    }
+    size_t nr_done = 0;
+    if (FLAGS_resume) {
+        if (FLAGS_sync_db) {
+            LOG(FATAL) << "--resume can't be combined with --sync_db.";
+        }
+        for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+            Checkpoint found;
+            Metadata metadata;
+            existing[shard] = boost::filesystem::is_directory(shard_names[shard]);
+            if (existing[shard] && metadata.Open(shard_names[shard], false) &&
+                metadata.ReadCheckpoint(&found)) {
+                if (found.label_hash != checkpoint.label_hash || found.settings != checkpoint.settings) {
+                    LOG(FATAL) << "Can't resume " << shard_names[shard] << ", it was imported "
+                               << "from another label file or with other options ("
+                               << found.settings << ").";
+                }
+                checkpoints[shard].next_line = found.next_line;
+            } else {
+                checkpoints[shard].next_line = shard;
+            }
+            resume_lines[shard] = checkpoints[shard].next_line;
+            nr_done += std::min(resume_lines[shard], nr_of_lines) / nr_of_shards;
+        }
+        LOG(INFO) << "Resuming the import, about " << nr_done << " files were already imported.";
+    } else {
+        for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+            checkpoints[shard].next_line = shard;
+        }
+    }
+
+    // Only import what's missing from an existing database.
+    // New records keep the number of their line in the label file, so they
+    // can't be shuffled.
+    SyncPlan sync_plan;
+    sync_plan.delete_keys.resize(nr_of_shards);
+    if (FLAGS_sync_db) {
+        sync_plan = plan_sync(*label_file, root_folder, shard_names);
+        size_t nr_to_delete = 0;
+        for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+            nr_to_delete += sync_plan.delete_keys[shard].size();
+        }
+        LOG(INFO) << "Syncing: " << sync_plan.unchanged << " images unchanged, "
+                  << sync_plan.import_lines.size() << " to import, " << nr_to_delete
+                  << " to remove.";
+        offsets.reset(new vector<uint64_t>());
+        offsets->swap(sync_plan.import_offsets);
+        line_numbers.reset(new vector<size_t>());
+        line_numbers->swap(sync_plan.import_lines);
+        nr_of_lines = offsets->size();
+    }
+
+    LOG(INFO) << "Starting to import " << nr_of_lines << " files"
+              << " with " << decode_threads << " reader thread(s) in "
+              << nr_of_shards << " database(s).";
+
+    // The queue limits are shared by all readers and writers.
+    size_t nr_of_queues = decode_threads * nr_of_shards;
+    size_t queue_capacity = std::max<int>(1, FLAGS_queue_capacity);
+    size_t queue_bytes = (size_t)std::max<int>(1, FLAGS_queue_megabytes) << 20;
+    queue_capacity = std::max<size_t>(1, queue_capacity / nr_of_queues);
+    queue_bytes /= nr_of_queues;
+
+    bool compute_mean = FLAGS_compute_mean;
+    if (compute_mean && image_options.encoded) {
+        LOG(WARNING) << "--compute_mean needs raw images, not computing the mean.";
+        compute_mean = false;
+    }
+    if (compute_mean && (FLAGS_sync_db || FLAGS_resume)) {
+        LOG(WARNING) << "The mean image only covers the images imported in this run.";
+    }
+
+    // Created first so it outlives the file reads in the queues.
+    shared_ptr<ReadAhead> read_ahead;
+    if (FLAGS_io_threads > 0) {
+        read_ahead.reset(new ReadAhead(FLAGS_io_threads, std::max<int>(1, FLAGS_read_ahead)));
+    }
+
+    shared_ptr<ImageCache> image_cache;
+    if (! FLAGS_image_cache.empty()) {
+        image_cache.reset(new ImageCache());
+        image_cache->Open(FLAGS_image_cache, image_options,
+                          (size_t)std::max<int>(1, FLAGS_image_cache_gigabytes) << 30);
+    }
+
+    shared_ptr<RecordPool> record_pool(new RecordPool());
+    shared_ptr<PipelineMetrics> metrics(new PipelineMetrics(nr_of_lines - std::min(nr_done,
+                                                                                 nr_of_lines)));
+    // queues[reader][shard]
+    vector<vector<shared_ptr<DatumQueue> > > queues(decode_threads);
+    vector<shared_ptr<LineQueue> > line_queues;
+    vector<shared_ptr<ImageStatistics> > image_statistics(decode_threads);
+    vector<std::thread> readers;
+    ImportRouting routing(decode_threads, nr_of_shards);
+    for (size_t i = 0; i < decode_threads; ++i) {
+        for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+            queues[i].push_back(shared_ptr<DatumQueue>(new DatumQueue(queue_capacity, queue_bytes)));
+        }
+        line_queues.push_back(shared_ptr<LineQueue>(new LineQueue(1024, 1 << 20)));
+        if (compute_mean) {
+            image_statistics[i].reset(new ImageStatistics());
+        }
+        ReaderThread rt(line_queues[i], root_folder, image_options, stats, queues[i], routing,
+                        record_pool, image_statistics[i], metrics,
+                        "reader " + caffe::format_int(i), image_cache);
+        readers.push_back(std::thread(rt));
+    }
+    ParserThread pt(label_file, offsets, line_numbers, resume_lines, line_queues, routing,
+                    root_folder, read_ahead, metrics, image_cache);
+    std::thread parser(pt);
+
+    std::thread progress;
+    if (FLAGS_progress_seconds > 0 || ! FLAGS_stats_file.empty()) {
+        vector<shared_ptr<DatumQueue> > datum_queues;
+        for (size_t i = 0; i < queues.size(); ++i) {
+            datum_queues.insert(datum_queues.end(), queues[i].begin(), queues[i].end());
+        }
+        ProgressThread progress_thread(metrics, line_queues, datum_queues,
+                                       FLAGS_progress_seconds);
+        progress = std::thread(progress_thread);
+    }
+
+    size_t map_size = estimate_map_size(label_file->Sample(16), nr_of_lines, root_folder,
+                                        image_options);
+    LOG(INFO) << "Estimated database size " << (map_size >> 20) << " MB.";
+
+    CommitPolicy commit_policy((size_t)std::max<int>(1, FLAGS_commit_megabytes) << 20,
+                               FLAGS_commit_seconds, FLAGS_commit_latency);
+
+    vector<std::thread> writers;
+    for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+        vector<shared_ptr<DatumQueue> > shard_queues;
+        for (size_t i = 0; i < decode_threads; ++i) {
+            shard_queues.push_back(queues[i][shard]);
+        }
+        WriterThread wt(shard_names[shard], shard, routing, shard_queues, record_pool,
+                        map_size / nr_of_shards, commit_policy, root_folder,
+                        sync_plan.delete_keys[shard], checkpoints[shard], existing[shard],
+                        metrics);
+        writers.push_back(std::thread(wt));
+    }
 
     // First finish reading all images
-    reader.join();
+    parser.join();
+    for (size_t i = 0; i < readers.size(); ++i) {
+        readers[i].join();
+    }
+    if (image_cache && ! image_cache->Flush()) {
+        LOG(ERROR) << "Not all images were added to the image cache.";
+    }
 
     // Then finish storing them all in the database
-    writer.join();
+    for (size_t shard = 0; shard < writers.size(); ++shard) {
+        writers[shard].join();
+    }
+
+    metrics->Stop();
+    if (progress.joinable()) {
+        progress.join();
+    }
+    vector<std::string> summary = metrics->Summary();
+    for (size_t i = 0; i < summary.size(); ++i) {
+        LOG(INFO) << summary[i];
+    }
+    if (! FLAGS_stats_file.empty()) {
+        std::ofstream stats_file(FLAGS_stats_file.c_str());
+        metrics->WriteJson(stats_file);
+        if (! stats_file) {
+            LOG(ERROR) << "Error writing the metrics to " << FLAGS_stats_file << ".";
+        }
+    }
+
+    if (nr_of_shards > 1) {
+        if (! write_shard_manifest(db_name, shard_names, FLAGS_integer_keys)) {
+            LOG(ERROR) << "Error writing " << db_name << ".manifest.";
+        }
+    }
+
+    if (compute_mean) {
+        write_image_statistics(db_name, image_statistics);
+    }
+
+    LOG(INFO) << "Allocated " << record_pool->NrOfAllocations() << " records for "
+              << nr_of_lines << " files.";
+    LOG(INFO) << "Loaded " << stats->images << " images: read "
+              << (stats->bytes_in >> 20) << " MB, stored " << (stats->bytes_out >> 20)
+              << " MB (" << (stats->bytes_in ? 100 * stats->bytes_out / stats->bytes_in : 0)
+              << "%).";
+    if (image_cache) {
+        uint64_t lookups = image_cache->Hits() + image_cache->Misses();
+        LOG(INFO) << "Image cache: " << image_cache->Hits() << " hits, "
+                  << image_cache->Misses() << " misses ("
+                  << (lookups ? 100 * image_cache->Hits() / lookups : 0) << "% hit rate).";
+    }
 
     return 0;
 }
@@ -0,0 +1,258 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "merge.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "glog/logging.h"
+
+#include "lmdb.hpp"
+#include "path_index.hpp"
+
+using boost::scoped_ptr;
+using boost::shared_ptr;
+using boost::string_ref;
+
+namespace {
+
+/* One input database, open for reading during the whole merge, so the keys
+   and values of its cursors stay valid. */
+struct MergeInput {
+    LMDB db;
+    scoped_ptr<LMDBReadTransaction> txn;
+};
+
+/* Orders the cursors by their current key, the cursor with the smallest key
+   first. Integer keys compare as numbers, like LMDB does. Ties go to the
+   earlier input, or to the later one if last_wins is set. */
+class CursorOrder {
+public:
+    CursorOrder(const std::vector<shared_ptr<LMDBCursor> >& cursors, bool integer_keys,
+                bool last_wins) :
+        cursors_(cursors), integer_keys_(integer_keys), last_wins_(last_wins) { }
+
+    bool Less(size_t a, size_t b) const {
+        int cmp = Compare(cursors_[a]->Key(), cursors_[b]->Key());
+        return cmp < 0 || (cmp == 0 && (last_wins_ ? a > b : a < b));
+    }
+
+    int Compare(string_ref key_a, string_ref key_b) const {
+        if (integer_keys_) {
+            size_t id_a = key_line_id(key_a), id_b = key_line_id(key_b);
+            return id_a < id_b ? -1 : (id_a > id_b ? 1 : 0);
+        }
+        return key_a.compare(key_b);
+    }
+
+    /* For std::push_heap and pop_heap, which keep the largest element first. */
+    bool operator()(size_t a, size_t b) const { return Less(b, a); }
+
+private:
+    const std::vector<shared_ptr<LMDBCursor> >& cursors_;
+    bool integer_keys_;
+    bool last_wins_;
+};
+
+/* Writes the merged records in batches. A batch refers to the memory maps
+   of the inputs until it is committed, so it can be stored again when the
+   map of the output is full. */
+class MergeOutput {
+public:
+    MergeOutput(LMDB* db, MDB_dbi* sub_db, size_t commit_bytes) :
+        db_(db), sub_db_(sub_db), commit_bytes_(commit_bytes), batch_bytes_(0) {
+        txn_.reset(db_->NewTransaction(sub_db_ == NULL));
+    }
+
+    bool Put(string_ref key, string_ref value) {
+        batch_.push_back(std::make_pair(key, value));
+        batch_bytes_ += key.size() + value.size();
+        if (! Store(key, value) && ! (txn_->MapFull() && GrowAndStoreBatch())) {
+            return false;
+        }
+        return batch_bytes_ < commit_bytes_ || Commit();
+    }
+
+    bool Commit() {
+        while (! txn_->Commit()) {
+            if (! txn_->MapFull() || ! GrowAndStoreBatch()) {
+                return false;
+            }
+        }
+        batch_.clear();
+        batch_bytes_ = 0;
+        txn_.reset(db_->NewTransaction(sub_db_ == NULL));
+        return true;
+    }
+
+private:
+    bool Store(string_ref key, string_ref value) {
+        return sub_db_ ? txn_->Put(*sub_db_, key, value) : txn_->Put(key, value);
+    }
+
+    bool GrowAndStoreBatch() {
+        bool stored = false;
+
+        while (! stored) {
+            txn_->Abort();
+            if (! db_->GrowMapSize()) {
+                return false;
+            }
+            txn_.reset(db_->NewTransaction(sub_db_ == NULL));
+            stored = true;
+            for (size_t i = 0; i < batch_.size() && stored; ++i) {
+                stored = Store(batch_[i].first, batch_[i].second);
+            }
+            if (! stored && ! txn_->MapFull()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    LMDB* db_;
+    MDB_dbi* sub_db_;
+    size_t commit_bytes_;
+    scoped_ptr<LMDBTransaction> txn_;
+    std::vector<std::pair<string_ref, string_ref> > batch_;
+    size_t batch_bytes_;
+};
+
+/* Merge the main databases of inputs, or the named database name. The
+   records are counted in stats, the index databases aren't. */
+bool merge_database(std::vector<shared_ptr<MergeInput> >& inputs, const char* name,
+                    unsigned int flags, bool last_wins, LMDB* output,
+                    const MergeOptions& options, MergeStatistics* stats) {
+    MDB_dbi output_db = 0;
+    std::vector<shared_ptr<LMDBCursor> > cursors;
+    std::vector<size_t> heap;
+    bool integer_keys = name ? (flags & MDB_INTEGERKEY) != 0 : options.integer_keys;
+    CursorOrder order(cursors, integer_keys, last_wins);
+
+    if (name && ! output->OpenSubDatabase(name, true, &output_db, flags)) {
+        LOG(ERROR) << "Can't create the database " << name << " in the output.";
+        return false;
+    }
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        MDB_dbi input_db;
+        if (name && ! inputs[i]->db.OpenSubDatabase(name, false, &input_db, flags)) {
+            LOG(ERROR) << "Input " << i << " has no database " << name << ".";
+            return false;
+        }
+        LMDBReadTransaction* txn = inputs[i]->txn.get();
+        cursors.push_back(shared_ptr<LMDBCursor>(name ? txn->NewCursor(input_db)
+                                                      : txn->NewCursor()));
+        if (cursors[i]->SeekToFirst()) {
+            heap.push_back(i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), order);
+
+    MergeOutput merged(output, name ? &output_db : NULL, options.commit_bytes);
+    string_ref last_key;
+    bool first = true;
+    while (! heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), order);
+        size_t i = heap.back();
+        string_ref key = cursors[i]->Key(), value = cursors[i]->Value();
+
+        if (! first && order.Compare(key, last_key) == 0) {
+            if (! name) {
+                stats->duplicates ++;
+            }
+        } else {
+            if (! merged.Put(key, value)) {
+                LOG(ERROR) << "Error storing the merged records.";
+                return false;
+            }
+            if (! name) {
+                stats->records ++;
+                stats->bytes += key.size() + value.size();
+            }
+            // Points into the memory map of the input, so it stays valid.
+            last_key = key;
+            first = false;
+        }
+
+        if (cursors[i]->Next()) {
+            std::push_heap(heap.begin(), heap.end(), order);
+        } else {
+            heap.pop_back();
+        }
+    }
+    return merged.Commit();
+}
+
+}  // namespace
+
+bool merge_databases(const std::vector<std::string>& inputs, const std::string& output,
+                     const MergeOptions& options, MergeStatistics* stats) {
+    std::vector<shared_ptr<MergeInput> > opened;
+    LMDB::Options input_options, output_options;
+    size_t map_size = 0;
+
+    if (boost::filesystem::exists(output)) {
+        LOG(ERROR) << "Output database " << output << " already exists.";
+        return false;
+    }
+    input_options.integer_keys = options.integer_keys;
+    input_options.max_dbs = options.integer_keys ? 2 : 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        shared_ptr<MergeInput> input(new MergeInput());
+        try {
+            input->db.Open(inputs[i], LMDB::READ, input_options);
+        } catch (std::runtime_error& e) {
+            LOG(ERROR) << "Can't open input database " << inputs[i] << ": " << e.what();
+            return false;
+        }
+        map_size += input->db.MapSize();
+        input->txn.reset(input->db.NewReadTransaction());
+        opened.push_back(input);
+    }
+
+    // The inputs together are about as large as the output, so the map
+    // rarely needs to grow.
+    output_options.map_size = map_size;
+    output_options.fast_import = options.fast_import;
+    output_options.integer_keys = options.integer_keys;
+    output_options.max_dbs = input_options.max_dbs;
+    LMDB db;
+    try {
+        db.Open(output, LMDB::NEW, output_options);
+    } catch (std::runtime_error& e) {
+        LOG(ERROR) << "Can't create output database " << output << ": " << e.what();
+        boost::filesystem::remove_all(output);
+        return false;
+    }
+
+    // An image listed more than once maps to its last key, see PathIndex::Put.
+    bool merged = merge_database(opened, NULL, 0, false, &db, options, stats) &&
+        (! options.integer_keys ||
+         (merge_database(opened, PathIndex::PATHS_DB, MDB_INTEGERKEY, false, &db, options, stats) &&
+          merge_database(opened, PathIndex::KEYS_DB, 0, true, &db, options, stats)));
+    if (! merged) {
+        // Don't leave a partial database behind.
+        db.Close();
+        boost::filesystem::remove_all(output);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef merge_h
+#define merge_h
+
+#include <string>
+#include <vector>
+
+struct MergeOptions {
+    MergeOptions() : integer_keys(false), commit_bytes(256 << 20), fast_import(false) { }
+
+    /* The inputs have integer keys and an index of the image paths, see
+       PathIndex. */
+    bool integer_keys;
+    /* Commit the output after about this many bytes. */
+    size_t commit_bytes;
+    bool fast_import;
+};
+
+struct MergeStatistics {
+    MergeStatistics() : records(0), bytes(0), duplicates(0) { }
+
+    size_t records;
+    size_t bytes;
+    /* Keys found in more than one input, only the first one is kept. */
+    size_t duplicates;
+};
+
+/* Merge the records of the databases inputs into a new database output.
+   The inputs are scanned with cursors in key order and merged k-way, so the
+   output is written in key order in append mode: both are sequential. The
+   records are copied as they are, without parsing them. Records imported
+   from different parts of one label file, see --partition, give the same
+   database as importing the label file at once. Returns false if output
+   already exists or on errors, an output that was created is removed
+   again. */
+bool merge_databases(const std::vector<std::string>& inputs, const std::string& output,
+                     const MergeOptions& options, MergeStatistics* stats);
+
+#endif /* merge_h */
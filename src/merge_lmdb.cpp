@@ -0,0 +1,74 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Merges databases imported with load_images_in_lmdb --partition=I/N into
+// one database.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "merge.hpp"
+
+DEFINE_bool(integer_keys, false,
+            "The inputs were imported with --integer_keys, also merge their index "
+            "of the image paths");
+DEFINE_int32(commit_megabytes, 256,
+             "Commit when the records stored since the last commit reach this size in MB");
+DEFINE_bool(fast_import, false,
+            "Don't sync the database to disk before the merge is done. Faster,"
+            " but a crash during the merge can leave the database corrupt");
+
+int main(int argc, char * argv[]) {
+#ifndef GFLAGS_GFLAGS_H_
+    namespace gflags = google;
+#endif
+
+    ::google::InitGoogleLogging(argv[0]);
+
+    gflags::SetUsageMessage("Merges LMDB databases into one new database, in key order.\n"
+                            "Usage:\n"
+                            "    merge_lmdb [FLAGS] OUTPUT_DB INPUT_DB...\n");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (argc < 3) {
+        gflags::ShowUsageWithFlagsRestrict(argv[0], "merge_lmdb");
+        return 1;
+    }
+
+    std::string output(argv[1]);
+    std::vector<std::string> inputs(argv + 2, argv + argc);
+
+    MergeOptions options;
+    options.integer_keys = FLAGS_integer_keys;
+    options.commit_bytes = (size_t)std::max<int>(1, FLAGS_commit_megabytes) << 20;
+    options.fast_import = FLAGS_fast_import;
+
+    MergeStatistics stats;
+    if (! merge_databases(inputs, output, options, &stats)) {
+        LOG(ERROR) << "Merging into " << output << " failed.";
+        return 1;
+    }
+    LOG(INFO) << "Merged " << stats.records << " records (" << (stats.bytes >> 20)
+              << " MB) from " << inputs.size() << " database(s) into " << output << ".";
+    if (stats.duplicates > 0) {
+        LOG(WARNING) << stats.duplicates << " duplicate key(s) were skipped, only the "
+                     << "record of the first database that has the key was kept.";
+    }
+    return 0;
+}
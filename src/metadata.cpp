@@ -0,0 +1,218 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metadata.hpp"
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <sstream>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "glog/logging.h"
+
+using boost::scoped_ptr;
+
+static const char* const sources_db = "sources";
+static const char* const progress_db = "progress";
+static const char* const checkpoint_key = "checkpoint";
+
+std::string record_key(size_t line_id, const std::string& image_path) {
+    std::string key;
+    record_key(line_id, image_path, &key);
+    return key;
+}
+
+void record_key(size_t line_id, boost::string_ref image_path, std::string* key) {
+    char line_number[32];
+    int size = snprintf(line_number, sizeof(line_number), "%08zu_", line_id);
+
+    key->assign(line_number, size);
+    key->append(image_path.data(), image_path.size());
+}
+
+boost::string_ref key_image_path(boost::string_ref key) {
+    size_t pos = key.find('_');
+
+    if (pos == boost::string_ref::npos || pos < 8) {
+        return boost::string_ref();
+    }
+    for (size_t i = 0; i < pos; ++i) {
+        if (key[i] < '0' || key[i] > '9') {
+            return boost::string_ref();
+        }
+    }
+    return key.substr(pos + 1);
+}
+
+std::string SourceInfo::Serialize() const {
+    std::ostringstream out;
+    out << label << " " << size << " " << mtime;
+    return out.str();
+}
+
+bool SourceInfo::Parse(boost::string_ref value) {
+    std::istringstream in(std::string(value.data(), value.size()));
+    return (in >> label >> size >> mtime) ? true : false;
+}
+
+bool read_source_info(const std::string& path, int label, SourceInfo* info) {
+    struct stat st;
+
+    if (stat(path.c_str(), &st)) {
+        return false;
+    }
+    info->label = label;
+    info->size = st.st_size;
+    info->mtime = st.st_mtime;
+    return true;
+}
+
+std::string Checkpoint::Serialize() const {
+    std::ostringstream out;
+    out << next_line << " " << label_hash << " " << settings;
+    return out.str();
+}
+
+bool Checkpoint::Parse(boost::string_ref value) {
+    std::istringstream in(std::string(value.data(), value.size()));
+    if (! (in >> next_line >> label_hash)) {
+        return false;
+    }
+    in.get();
+    std::getline(in, settings);
+    return true;
+}
+
+bool Metadata::Open(const std::string& db_name, bool create, bool fast_import) {
+    std::string path = (boost::filesystem::path(db_name) / "meta").string();
+    bool exists = boost::filesystem::is_directory(path);
+    LMDB::Options options;
+
+    if (! exists && ! create) {
+        return false;
+    }
+    options.max_dbs = 4;
+    options.fast_import = fast_import;
+    // Existing metadata is kept up to date also by imports that don't
+    // create it, like a sync without --track_sources.
+    db_.Open(path, exists ? LMDB::WRITE : LMDB::NEW, options);
+    return true;
+}
+
+bool Metadata::SubDatabase(const std::string& name, bool create, MDB_dbi* sub_db) {
+    std::map<std::string, MDB_dbi>::const_iterator it = sub_dbs_.find(name);
+
+    if (it != sub_dbs_.end()) {
+        *sub_db = it->second;
+        return true;
+    }
+    if (! db_.OpenSubDatabase(name, create, sub_db)) {
+        return false;
+    }
+    sub_dbs_[name] = *sub_db;
+    return true;
+}
+
+bool Metadata::PutSources(const std::vector<std::pair<std::string, SourceInfo> >& sources) {
+    return Write(sources, std::vector<std::string>(), NULL);
+}
+
+bool Metadata::DeleteSources(const std::vector<std::string>& keys) {
+    return Write(std::vector<std::pair<std::string, SourceInfo> >(), keys, NULL);
+}
+
+bool Metadata::PutCheckpoint(const Checkpoint& checkpoint,
+                             const std::vector<std::pair<std::string, SourceInfo> >& sources) {
+    return Write(sources, std::vector<std::string>(), &checkpoint);
+}
+
+// Apply the changes in one transaction, growing the map until they fit.
+bool Metadata::Write(const std::vector<std::pair<std::string, SourceInfo> >& puts,
+                     const std::vector<std::string>& deletes, const Checkpoint* checkpoint) {
+    MDB_dbi sources, progress;
+
+    if ((! puts.empty() || ! deletes.empty()) && ! SubDatabase(sources_db, true, &sources)) {
+        return false;
+    }
+    if (checkpoint && ! SubDatabase(progress_db, true, &progress)) {
+        return false;
+    }
+    while (true) {
+        scoped_ptr<LMDBTransaction> txn(db_.NewTransaction());
+        if (! txn) {
+            return false;
+        }
+        bool stored = true;
+        for (size_t i = 0; i < deletes.size() && stored; ++i) {
+            stored = txn->Delete(sources, deletes[i]);
+        }
+        for (size_t i = 0; i < puts.size() && stored; ++i) {
+            stored = txn->Put(sources, puts[i].first, puts[i].second.Serialize());
+        }
+        if (checkpoint && stored) {
+            stored = txn->Put(progress, checkpoint_key, checkpoint->Serialize());
+        }
+        if (stored && txn->Commit()) {
+            return true;
+        }
+        if (! txn->MapFull()) {
+            return false;
+        }
+        txn->Abort();
+        if (! db_.GrowMapSize()) {
+            return false;
+        }
+    }
+}
+
+bool Metadata::HasSources() {
+    MDB_dbi sources;
+    return SubDatabase(sources_db, false, &sources);
+}
+
+bool Metadata::ReadSources(std::map<std::string, SourceInfo>* sources) {
+    MDB_dbi sources_dbi;
+
+    if (! SubDatabase(sources_db, false, &sources_dbi)) {
+        return false;
+    }
+    scoped_ptr<LMDBReadTransaction> txn(db_.NewReadTransaction());
+    if (! txn) {
+        return false;
+    }
+    scoped_ptr<LMDBCursor> cursor(txn->NewCursor(sources_dbi));
+    if (! cursor) {
+        return false;
+    }
+    for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+        SourceInfo info;
+        if (info.Parse(cursor->Value())) {
+            (*sources)[cursor->Key().to_string()] = info;
+        }
+    }
+    return true;
+}
+
+bool Metadata::ReadCheckpoint(Checkpoint* checkpoint) {
+    MDB_dbi progress;
+    boost::string_ref value;
+
+    if (! SubDatabase(progress_db, false, &progress)) {
+        return false;
+    }
+    scoped_ptr<LMDBReadTransaction> txn(db_.NewReadTransaction());
+    return txn && txn->Get(progress, checkpoint_key, &value) && checkpoint->Parse(value);
+}
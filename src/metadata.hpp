@@ -0,0 +1,108 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef metadata_h
+#define metadata_h
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <boost/utility/string_ref.hpp>
+
+#include "lmdb.hpp"
+
+/* Key of the record of line line_id of the label file: the zero-padded line
+   number and the image path, so records sort in label file order. */
+std::string record_key(size_t line_id, const std::string& image_path);
+/* Same, in key, reusing its buffer. */
+void record_key(size_t line_id, boost::string_ref image_path, std::string* key);
+
+/* The image path in a key made by record_key, empty for other keys. */
+boost::string_ref key_image_path(boost::string_ref key);
+
+/* Where a record came from: the label and the size and modification time of
+   the image file when it was imported. */
+struct SourceInfo {
+    SourceInfo() : label(0), size(0), mtime(0) { }
+
+    bool operator==(const SourceInfo& other) const {
+        return label == other.label && size == other.size && mtime == other.mtime;
+    }
+    bool operator!=(const SourceInfo& other) const { return ! (*this == other); }
+
+    std::string Serialize() const;
+    bool Parse(boost::string_ref value);
+
+    int label;
+    uint64_t size;
+    int64_t mtime;
+};
+
+/* Look up the size and modification time of the image at path. */
+bool read_source_info(const std::string& path, int label, SourceInfo* info);
+
+/* How far an import got: all lines of the label file before next_line that
+   go to this database are committed. label_hash and settings identify the
+   label file and the options of the import, so it is only resumed with the
+   same ones. */
+struct Checkpoint {
+    Checkpoint() : next_line(0), label_hash(0) { }
+
+    std::string Serialize() const;
+    bool Parse(boost::string_ref value);
+
+    uint64_t next_line;
+    uint64_t label_hash;
+    std::string settings;
+};
+
+/* Information about the records of a database that Caffe doesn't need. It is
+   kept in a separate environment in the meta folder of the database, so the
+   main database only holds datums. */
+class Metadata {
+
+public:
+    /* Open the metadata of the database at db_name for writing. Returns
+       false when it doesn't exist and create is false. With fast_import the metadata is
+       only synced to disk when it is closed, like the database itself. */
+    bool Open(const std::string& db_name, bool create, bool fast_import = false);
+    void Close() { db_.Close(); }
+
+    /* Record the sources of a batch of keys, in one transaction. */
+    bool PutSources(const std::vector<std::pair<std::string, SourceInfo> >& sources);
+    bool DeleteSources(const std::vector<std::string>& keys);
+    /* All recorded sources, by key. Returns false if no sources were ever
+       recorded. */
+    bool ReadSources(std::map<std::string, SourceInfo>* sources);
+    bool HasSources();
+
+    /* Record the progress of the import together with the sources of the
+       records committed since the last checkpoint, in one transaction. */
+    bool PutCheckpoint(const Checkpoint& checkpoint,
+                       const std::vector<std::pair<std::string, SourceInfo> >& sources);
+    bool ReadCheckpoint(Checkpoint* checkpoint);
+
+private:
+    bool SubDatabase(const std::string& name, bool create, MDB_dbi* sub_db);
+    bool Write(const std::vector<std::pair<std::string, SourceInfo> >& puts,
+               const std::vector<std::string>& deletes, const Checkpoint* checkpoint);
+
+    LMDB db_;
+    std::map<std::string, MDB_dbi> sub_dbs_;
+};
+
+#endif /* metadata_h */
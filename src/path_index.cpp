@@ -0,0 +1,102 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "path_index.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "glog/logging.h"
+
+const char* const PathIndex::PATHS_DB = "paths";
+const char* const PathIndex::KEYS_DB = "keys";
+
+void integer_key(size_t line_id, std::string* key) {
+    key->assign(reinterpret_cast<const char*>(&line_id), sizeof(line_id));
+}
+
+std::string integer_key(size_t line_id) {
+    std::string key;
+    integer_key(line_id, &key);
+    return key;
+}
+
+size_t key_line_id(boost::string_ref key) {
+    size_t line_id;
+
+    if (key.size() != sizeof(line_id)) {
+        return SIZE_MAX;
+    }
+    memcpy(&line_id, key.data(), sizeof(line_id));
+    return line_id;
+}
+
+std::string path_hash(boost::string_ref image_path) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < image_path.size(); ++i) {
+        hash ^= static_cast<unsigned char>(image_path[i]);
+        hash *= 1099511628211ULL;
+    }
+    return std::string(reinterpret_cast<const char*>(&hash), sizeof(hash));
+}
+
+// A KEYS_DB value: the integer key of the record, then the image path.
+static bool split_keys_value(boost::string_ref value, boost::string_ref* key,
+                             boost::string_ref* image_path) {
+    if (value.size() < sizeof(size_t)) {
+        return false;
+    }
+    *key = value.substr(0, sizeof(size_t));
+    *image_path = value.substr(sizeof(size_t));
+    return true;
+}
+
+bool PathIndex::Open(LMDB* db, bool create) {
+    return db->OpenSubDatabase(PATHS_DB, create, &paths_, MDB_INTEGERKEY) &&
+           db->OpenSubDatabase(KEYS_DB, create, &keys_);
+}
+
+bool PathIndex::Put(LMDBTransaction* txn, const std::string& key,
+                    const std::string& image_path) {
+    std::string hash = path_hash(image_path);
+    boost::string_ref existing, existing_key, existing_path;
+
+    if (key.size() != sizeof(size_t)) {
+        LOG(ERROR) << "The path index needs integer keys.";
+        return false;
+    }
+    if (txn->Get(keys_, hash, &existing) &&
+        split_keys_value(existing, &existing_key, &existing_path) &&
+        existing_path != image_path) {
+        LOG(ERROR) << "Image paths " << existing_path << " and " << image_path
+                   << " have the same hash, can't index both.";
+        return false;
+    }
+    return txn->Put(paths_, key, image_path) && txn->Put(keys_, hash, key + image_path);
+}
+
+bool PathIndex::ImagePath(LMDBReadTransaction* txn, const std::string& key,
+                          boost::string_ref* image_path) {
+    return txn->Get(paths_, key, image_path);
+}
+
+bool PathIndex::Key(LMDBReadTransaction* txn, const std::string& image_path,
+                    boost::string_ref* key) {
+    boost::string_ref value, indexed_path;
+
+    return txn->Get(keys_, path_hash(image_path), &value) &&
+           split_keys_value(value, key, &indexed_path) && indexed_path == image_path;
+}
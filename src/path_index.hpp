@@ -0,0 +1,70 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef path_index_h
+#define path_index_h
+
+#include <string>
+#include <boost/utility/string_ref.hpp>
+
+#include "lmdb.hpp"
+
+/* Key of the record of line line_id in a database with integer keys: the
+   line number as a size_t, see LMDB::Options::integer_keys. Such keys are
+   8 bytes, however long the image path. */
+void integer_key(size_t line_id, std::string* key);
+std::string integer_key(size_t line_id);
+/* The line number in an integer key, SIZE_MAX if key isn't one. */
+size_t key_line_id(boost::string_ref key);
+
+/* With integer keys the image paths are kept next to the records, in two
+   named databases of the same environment: PATHS_DB maps keys to image
+   paths and KEYS_DB image paths to keys. LMDB keys are at most 511 bytes,
+   so KEYS_DB is keyed on the hash of the image path, see path_hash, and
+   stores the key followed by the image path to tell paths with the same
+   hash apart. The index is stored in the transaction of the records, so
+   both are committed together. The database needs at least 2 for
+   max_dbs. */
+/* The key of an image path in KEYS_DB: the FNV-1a hash of the path as 8
+   bytes. */
+std::string path_hash(boost::string_ref image_path);
+
+class PathIndex {
+
+public:
+    static const char* const PATHS_DB;
+    static const char* const KEYS_DB;
+
+    PathIndex() : paths_(0), keys_(0) { }
+
+    /* Open the index of db, created if create is set. Returns false if the
+       database has no index. */
+    bool Open(LMDB* db, bool create);
+
+    /* An image that is listed more than once maps to its last key. key must
+       be an integer key. Fails if another image path has the same hash. */
+    bool Put(LMDBTransaction* txn, const std::string& key, const std::string& image_path);
+
+    /* Look up the image path of a key, or the key of an image path. The
+       result points into the memory map, like LMDBReadTransaction::Get. */
+    bool ImagePath(LMDBReadTransaction* txn, const std::string& key, boost::string_ref* image_path);
+    bool Key(LMDBReadTransaction* txn, const std::string& image_path, boost::string_ref* key);
+
+private:
+    MDB_dbi paths_;
+    MDB_dbi keys_;
+};
+
+#endif /* path_index_h */
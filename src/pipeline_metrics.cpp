@@ -0,0 +1,220 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pipeline_metrics.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+LatencyHistogram::LatencyHistogram() : count_(0), total_us_(0), max_us_(0) {
+    for (int i = 0; i < NR_OF_BUCKETS; ++i) {
+        buckets_[i] = 0;
+    }
+}
+
+void LatencyHistogram::Add(double seconds) {
+    uint64_t us = (uint64_t)(std::max(0.0, seconds) * 1e6);
+    int bucket = 0;
+
+    while (bucket < NR_OF_BUCKETS - 1 && (us >> bucket) > 0) {
+        bucket ++;
+    }
+    buckets_[bucket] ++;
+    count_ ++;
+    total_us_ += us;
+    uint64_t max_us = max_us_;
+    while (us > max_us && ! max_us_.compare_exchange_weak(max_us, us)) { }
+}
+
+double LatencyHistogram::BucketLimit(int bucket) {
+    return (double)((uint64_t)1 << bucket) * 1e-6;
+}
+
+double LatencyHistogram::Percentile(double p) const {
+    uint64_t count = count_;
+    uint64_t seen = 0;
+
+    if (count == 0) {
+        return 0;
+    }
+    for (int i = 0; i < NR_OF_BUCKETS; ++i) {
+        seen += buckets_[i];
+        if (seen * 100 >= p * count) {
+            return std::min(BucketLimit(i), MaxSeconds());
+        }
+    }
+    return MaxSeconds();
+}
+
+const char* const PipelineMetrics::STAGE_NAMES[NR_OF_STAGES] = {
+    "read", "decode", "put", "commit"
+};
+
+PipelineMetrics::PipelineMetrics(size_t nr_of_images) :
+    nr_of_images_(nr_of_images), start_(std::chrono::steady_clock::now()), images_(0),
+    images_stored_(0), bytes_written_(0), stopped_(false) { }
+
+double PipelineMetrics::Elapsed() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+}
+
+ThreadMetrics* PipelineMetrics::AddThread(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.push_back(shared_ptr<ThreadMetrics>(new ThreadMetrics(name)));
+    return threads_.back().get();
+}
+
+void PipelineMetrics::AddImage(size_t bytes) {
+    images_ ++;
+    if (bytes > 0) {
+        images_stored_ ++;
+        bytes_written_ += bytes;
+    }
+}
+
+void PipelineMetrics::AddMapResize(size_t map_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    map_resizes_.push_back(std::make_pair(Elapsed(), map_size));
+}
+
+void PipelineMetrics::AddQueueSample(size_t line_items, size_t datum_items, size_t datum_bytes) {
+    QueueSample sample = { Elapsed(), line_items, datum_items, datum_bytes };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_samples_.push_back(sample);
+}
+
+std::string PipelineMetrics::Progress() const {
+    std::ostringstream line;
+    double elapsed = Elapsed();
+    size_t images = images_;
+    double rate = elapsed > 0 ? images / elapsed : 0;
+
+    line << "Processed " << images << " of " << nr_of_images_ << " files";
+    if (nr_of_images_ > 0) {
+        line << " (" << 100 * std::min(images, nr_of_images_) / nr_of_images_ << "%)";
+    }
+    line << ", " << std::fixed << std::setprecision(1) << rate << " files/s, "
+         << (bytes_written_ >> 20) << " MB written";
+    if (rate > 0 && images < nr_of_images_) {
+        size_t left = (size_t)((nr_of_images_ - images) / rate);
+        line << ", ETA " << left / 3600 << ":" << std::setfill('0') << std::setw(2)
+             << left / 60 % 60 << ":" << std::setw(2) << left % 60;
+    }
+    line << ".";
+    return line.str();
+}
+
+std::vector<std::string> PipelineMetrics::Summary() const {
+    std::vector<std::string> lines;
+
+    for (int stage = 0; stage < NR_OF_STAGES; ++stage) {
+        const LatencyHistogram& histogram = stages_[stage];
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(3) << STAGE_NAMES[stage] << ": "
+             << histogram.Count() << " times, " << histogram.TotalSeconds() << " s, p50 "
+             << histogram.Percentile(50) * 1e3 << " ms, p99 "
+             << histogram.Percentile(99) * 1e3 << " ms, max " << histogram.MaxSeconds() * 1e3
+             << " ms.";
+        lines.push_back(line.str());
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        const ThreadMetrics& thread = *threads_[i];
+        double total = thread.BusySeconds() + thread.IdleSeconds();
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2) << thread.Name() << ": busy "
+             << thread.BusySeconds() << " s, waiting " << thread.IdleSeconds() << " s ("
+             << std::setprecision(1) << (total > 0 ? 100 * thread.BusySeconds() / total : 0)
+             << "% busy).";
+        lines.push_back(line.str());
+    }
+    return lines;
+}
+
+void PipelineMetrics::WriteJson(std::ostream& out) const {
+    double elapsed = Elapsed();
+
+    out << "{\n";
+    out << "  \"seconds\": " << elapsed << ",\n";
+    out << "  \"images\": {\"total\": " << nr_of_images_ << ", \"processed\": " << images_
+        << ", \"stored\": " << images_stored_ << "},\n";
+    out << "  \"images_per_second\": " << (elapsed > 0 ? images_ / elapsed : 0) << ",\n";
+    out << "  \"bytes_written\": " << bytes_written_ << ",\n";
+
+    out << "  \"stages\": {\n";
+    for (int stage = 0; stage < NR_OF_STAGES; ++stage) {
+        const LatencyHistogram& histogram = stages_[stage];
+        out << "    \"" << STAGE_NAMES[stage] << "\": {\"count\": " << histogram.Count()
+            << ", \"seconds\": " << histogram.TotalSeconds()
+            << ", \"p50\": " << histogram.Percentile(50)
+            << ", \"p90\": " << histogram.Percentile(90)
+            << ", \"p99\": " << histogram.Percentile(99)
+            << ", \"max\": " << histogram.MaxSeconds() << ",\n";
+        // Only the buckets up to the last one in use, as [limit, count].
+        int last = LatencyHistogram::NR_OF_BUCKETS - 1;
+        while (last > 0 && histogram.BucketCount(last) == 0) {
+            last --;
+        }
+        out << "      \"histogram\": [";
+        for (int i = 0; i <= last; ++i) {
+            out << (i ? ", " : "") << "[" << LatencyHistogram::BucketLimit(i) << ", "
+                << histogram.BucketCount(i) << "]";
+        }
+        out << "]}" << (stage + 1 < NR_OF_STAGES ? "," : "") << "\n";
+    }
+    out << "  },\n";
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "  \"threads\": [";
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << threads_[i]->Name()
+            << "\", \"busy_seconds\": " << threads_[i]->BusySeconds()
+            << ", \"idle_seconds\": " << threads_[i]->IdleSeconds() << "}";
+    }
+    out << "\n  ],\n";
+
+    out << "  \"map_resizes\": [";
+    for (size_t i = 0; i < map_resizes_.size(); ++i) {
+        out << (i ? ", " : "") << "{\"seconds\": " << map_resizes_[i].first
+            << ", \"map_size\": " << map_resizes_[i].second << "}";
+    }
+    out << "],\n";
+
+    out << "  \"queues\": [";
+    for (size_t i = 0; i < queue_samples_.size(); ++i) {
+        const QueueSample& sample = queue_samples_[i];
+        out << (i ? ",\n" : "\n") << "    {\"seconds\": " << sample.seconds
+            << ", \"line_items\": " << sample.line_items
+            << ", \"datum_items\": " << sample.datum_items
+            << ", \"datum_bytes\": " << sample.datum_bytes << "}";
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+}
+
+bool PipelineMetrics::WaitForStop(double seconds) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return stop_changed_.wait_for(lock, std::chrono::duration<double>(seconds),
+                                  [this] { return stopped_; });
+}
+
+void PipelineMetrics::Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+    stop_changed_.notify_all();
+}
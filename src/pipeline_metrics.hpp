@@ -0,0 +1,156 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef pipeline_metrics_h
+#define pipeline_metrics_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+
+using boost::shared_ptr;
+
+/* Measures the time between laps. */
+class Stopwatch {
+
+public:
+    Stopwatch() : last_(std::chrono::steady_clock::now()) { }
+
+    /* Seconds since the previous lap, or since the stopwatch was made. */
+    double Lap() {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last_).count();
+        last_ = now;
+        return seconds;
+    }
+
+private:
+    std::chrono::steady_clock::time_point last_;
+};
+
+/* Counts latencies in buckets of powers of two microseconds: bucket 0 holds
+   latencies under 1 us, bucket i those from 2^(i-1) up to 2^i us. Threads
+   can add latencies concurrently. */
+class LatencyHistogram {
+
+public:
+    static const int NR_OF_BUCKETS = 32;
+
+    LatencyHistogram();
+
+    void Add(double seconds);
+
+    size_t Count() const { return count_; }
+    double TotalSeconds() const { return total_us_ * 1e-6; }
+    double MaxSeconds() const { return max_us_ * 1e-6; }
+    size_t BucketCount(int bucket) const { return buckets_[bucket]; }
+    /* Upper bound in seconds of the bucket that holds percentile p, at most
+       the largest latency. */
+    double Percentile(double p) const;
+    static double BucketLimit(int bucket);
+
+private:
+    std::atomic<uint64_t> buckets_[NR_OF_BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> total_us_;
+    std::atomic<uint64_t> max_us_;
+};
+
+/* Time a thread spent working and waiting for its queues. */
+class ThreadMetrics {
+
+public:
+    explicit ThreadMetrics(const std::string& name) : name_(name), busy_us_(0), idle_us_(0) { }
+
+    void Busy(double seconds) { busy_us_ += (uint64_t)(seconds * 1e6); }
+    void Idle(double seconds) { idle_us_ += (uint64_t)(seconds * 1e6); }
+
+    const std::string& Name() const { return name_; }
+    double BusySeconds() const { return busy_us_ * 1e-6; }
+    double IdleSeconds() const { return idle_us_ * 1e-6; }
+
+private:
+    std::string name_;
+    std::atomic<uint64_t> busy_us_;
+    std::atomic<uint64_t> idle_us_;
+};
+
+/* Metrics of an import: the latencies of its stages, the time each thread
+   was busy or waiting, how full the queues were over time and how the map
+   grew. Shows whether an import is bound by reading, decoding or
+   committing. */
+class PipelineMetrics {
+
+public:
+    enum Stage { READ, DECODE, PUT, COMMIT, NR_OF_STAGES };
+
+    explicit PipelineMetrics(size_t nr_of_images);
+
+    /* Time to get the file of an image, to decode it into a datum, to store
+       the datum in the transaction, which includes serializing it, and to
+       commit a batch. */
+    void AddLatency(Stage stage, double seconds) { stages_[stage].Add(seconds); }
+    /* Register a thread, the metrics stay valid as long as this object. */
+    ThreadMetrics* AddThread(const std::string& name);
+    /* A writer took an image from the queues, bytes is 0 if it failed to
+       load. */
+    void AddImage(size_t bytes);
+    void AddMapResize(size_t map_size);
+    void AddQueueSample(size_t line_items, size_t datum_items, size_t datum_bytes);
+
+    /* One line with the rate, progress and expected time left. */
+    std::string Progress() const;
+    /* Summary per stage and thread, for the log. */
+    std::vector<std::string> Summary() const;
+    void WriteJson(std::ostream& out) const;
+
+    /* Wait up to seconds, returns true once Stop was called. */
+    bool WaitForStop(double seconds);
+    void Stop();
+
+private:
+    double Elapsed() const;
+
+    static const char* const STAGE_NAMES[NR_OF_STAGES];
+
+    struct QueueSample {
+        double seconds;
+        size_t line_items;
+        size_t datum_items;
+        size_t datum_bytes;
+    };
+
+    size_t nr_of_images_;
+    std::chrono::steady_clock::time_point start_;
+    LatencyHistogram stages_[NR_OF_STAGES];
+    std::atomic<uint64_t> images_;
+    std::atomic<uint64_t> images_stored_;
+    std::atomic<uint64_t> bytes_written_;
+
+    mutable std::mutex mutex_;
+    std::vector<shared_ptr<ThreadMetrics> > threads_;
+    std::vector<std::pair<double, size_t> > map_resizes_;
+    std::vector<QueueSample> queue_samples_;
+    bool stopped_;
+    std::condition_variable stop_changed_;
+};
+
+#endif /* pipeline_metrics_h */
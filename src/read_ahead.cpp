@@ -0,0 +1,116 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "read_ahead.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+bool read_file(const std::string& path, std::vector<unsigned char>* contents) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st)) {
+        close(fd);
+        return false;
+    }
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+    contents->resize(st.st_size);
+    size_t size = 0;
+    while (true) {
+        if (size == contents->size()) {
+            // The file may have grown since fstat.
+            contents->resize(size + 4096);
+        }
+        ssize_t n = read(fd, &(*contents)[size], contents->size() - size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            contents->resize(size);
+            return n == 0;
+        }
+        size += n;
+    }
+}
+
+FileRead::~FileRead() {
+    owner_->Release();
+}
+
+bool FileRead::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_changed_.wait(lock, [this] { return done_; });
+    return success_;
+}
+
+void FileRead::Done(bool success) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+    success_ = success;
+    done_changed_.notify_all();
+}
+
+ReadAhead::ReadAhead(size_t nr_of_threads, size_t max_files) :
+    max_files_(std::max<size_t>(1, max_files)), nr_of_files_(0),
+    pending_(max_files_, SIZE_MAX) {
+    for (size_t i = 0; i < std::max<size_t>(1, nr_of_threads); ++i) {
+        threads_.push_back(std::thread(&ReadAhead::Run, this));
+    }
+}
+
+ReadAhead::~ReadAhead() {
+    pending_.Close();
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        threads_[i].join();
+    }
+}
+
+shared_ptr<FileRead> ReadAhead::Read(const std::string& path) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this] { return nr_of_files_ < max_files_; });
+        nr_of_files_ ++;
+    }
+    shared_ptr<FileRead> file_read(new FileRead(this, path));
+    pending_.Push(file_read, 0);
+    return file_read;
+}
+
+void ReadAhead::Release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nr_of_files_ --;
+    released_.notify_one();
+}
+
+void ReadAhead::Run() {
+    shared_ptr<FileRead> file_read;
+
+    while (pending_.Pop(file_read)) {
+        file_read->Done(read_file(file_read->path_, &file_read->contents_));
+        file_read.reset();
+    }
+}
@@ -0,0 +1,88 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef read_ahead_h
+#define read_ahead_h
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "blocking_queue.hpp"
+
+using boost::shared_ptr;
+
+/* Read the whole file at path. The kernel is told up front that all of it
+   is needed, so it reads it in one go instead of in read-ahead windows. */
+bool read_file(const std::string& path, std::vector<unsigned char>* contents);
+
+class ReadAhead;
+
+/* A file that is being read by a ReadAhead pool. */
+class FileRead {
+
+public:
+    FileRead(ReadAhead* owner, const std::string& path) :
+        owner_(owner), path_(path), done_(false), success_(false) { }
+    /* Makes room in the pool for the next read. */
+    virtual ~FileRead();
+
+    /* Wait until the file is read. Returns false if it couldn't be read. */
+    bool Wait();
+    const std::string& Path() const { return path_; }
+    const std::vector<unsigned char>& Contents() const { return contents_; }
+
+private:
+    friend class ReadAhead;
+    void Done(bool success);
+
+    ReadAhead* owner_;
+    std::string path_;
+    std::vector<unsigned char> contents_;
+    bool done_;
+    bool success_;
+    std::mutex mutex_;
+    std::condition_variable done_changed_;
+};
+
+/* Reads files ahead of the decoders, on a pool of nr_of_threads threads. At
+   most max_files files are being read or held in memory at a time: Read
+   blocks until an earlier FileRead is deleted. */
+class ReadAhead {
+
+public:
+    ReadAhead(size_t nr_of_threads, size_t max_files);
+    virtual ~ReadAhead();
+
+    /* Start reading the file at path. */
+    shared_ptr<FileRead> Read(const std::string& path);
+
+private:
+    friend class FileRead;
+    void Run();
+    void Release();
+
+    size_t max_files_;
+    size_t nr_of_files_;
+    BlockingQueue<shared_ptr<FileRead> > pending_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable released_;
+};
+
+#endif /* read_ahead_h */
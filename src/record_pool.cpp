@@ -0,0 +1,49 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "record_pool.hpp"
+
+shared_ptr<Record> RecordPool::Get() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (! free_.empty()) {
+            shared_ptr<Record> record = std::move(free_.back());
+            free_.pop_back();
+            return record;
+        }
+        nr_of_allocations_ ++;
+    }
+    return shared_ptr<Record>(new Record());
+}
+
+void RecordPool::Put(shared_ptr<Record> record) {
+    if (! record) {
+        return;
+    }
+    record->loaded = false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(std::move(record));
+}
+
+size_t RecordPool::NrOfAllocations() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nr_of_allocations_;
+}
+
+size_t RecordPool::NrOfFreeRecords() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+}
@@ -0,0 +1,67 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef record_pool_h
+#define record_pool_h
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <boost/shared_ptr.hpp>
+
+#include "caffe/proto/caffe.pb.h"
+
+using boost::shared_ptr;
+
+/* The key and datum of one line of the label file, on its way from a reader
+   to a writer. */
+struct Record {
+    Record() : loaded(false) { }
+
+    std::string key;
+    /* Only set with integer keys, which don't hold the image path. */
+    std::string image_path;
+    caffe::Datum datum;
+    /* False if the image couldn't be loaded. The record is still passed on
+       so the writer stays in step with the reader. */
+    bool loaded;
+};
+
+/* Recycles records between the readers and the writers. A record keeps the
+   buffers of its key and datum when it is returned, so once the pool holds
+   as many records as are in flight, importing an image doesn't allocate
+   memory for its record. Get never blocks: it allocates a record when none
+   is free. The pool doesn't need a limit of its own, the records in flight
+   are bounded by the queues and the uncommitted batches of the writers. */
+class RecordPool {
+
+public:
+    RecordPool() : nr_of_allocations_(0) { }
+
+    shared_ptr<Record> Get();
+    /* Return a record that is no longer used. */
+    void Put(shared_ptr<Record> record);
+
+    /* Number of records allocated by Get. */
+    size_t NrOfAllocations();
+    size_t NrOfFreeRecords();
+
+private:
+    size_t nr_of_allocations_;
+    std::vector<shared_ptr<Record> > free_;
+    std::mutex mutex_;
+};
+
+#endif /* record_pool_h */
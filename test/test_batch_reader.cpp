@@ -0,0 +1,131 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#define CPU_ONLY
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+using boost::shared_ptr;
+using boost::scoped_ptr;
+
+#include <set>
+
+#include "lmdb.hpp"
+#include "batch_reader.hpp"
+
+static const std::string databases_folder = "test/test_working/";
+
+/* Create a database with 10 small datums, label i holds pixel value
+   first_pixel + i. */
+static shared_ptr<LMDB> create_batch_database(const std::string& name, int first_pixel = 0) {
+    std::string db_path = databases_folder + name;
+    boost::filesystem::remove_all(db_path);
+
+    shared_ptr<LMDB> db(new LMDB());
+    db->Open(db_path, LMDB::NEW);
+
+    scoped_ptr<LMDBTransaction> txn(db->NewTransaction(true));
+    caffe::Datum datum;
+    datum.set_channels(3);
+    datum.set_height(2);
+    datum.set_width(2);
+    for (int i = 0; i < 10; ++i) {
+        datum.set_label(i);
+        datum.set_data(std::string(3 * 2 * 2, (char)(first_pixel + i)));
+        db->StoreDatum(txn.get(), caffe::format_int(i, 8), &datum);
+    }
+    txn->Commit();
+
+    return db;
+}
+
+BOOST_AUTO_TEST_CASE(read_sequential_batches)
+{
+    shared_ptr<LMDB> db = create_batch_database("test_read_sequential_batches");
+    BatchReader reader(db.get(), 4, BatchReader::SEQUENTIAL);
+
+    BOOST_CHECK_EQUAL( reader.NrOfRecords(), 10 );
+
+    /* 3 batches of 4 wrap around into the second epoch. */
+    for (int b = 0; b < 3; ++b) {
+        const Batch& batch = reader.Next();
+        BOOST_CHECK_EQUAL( batch.epoch, b * 4 / 10 );
+        BOOST_CHECK_EQUAL( batch.channels, 3 );
+        BOOST_CHECK_EQUAL( batch.height, 2 );
+        BOOST_CHECK_EQUAL( batch.width, 2 );
+        BOOST_REQUIRE_EQUAL( batch.data.size(), 4 * 12 );
+        for (int i = 0; i < 4; ++i) {
+            int label = (b * 4 + i) % 10;
+            BOOST_CHECK_EQUAL( batch.labels[i], label );
+            BOOST_CHECK_EQUAL( batch.data[i * 12], label );
+            BOOST_CHECK_EQUAL( batch.data[i * 12 + 11], label );
+        }
+    }
+    BOOST_CHECK_EQUAL( reader.NrOfRecordsRead(), 12 );
+}
+
+BOOST_AUTO_TEST_CASE(read_shuffled_float_batches)
+{
+    shared_ptr<LMDB> db = create_batch_database("test_read_shuffled_float_batches");
+    BatchReader reader(db.get(), 5, BatchReader::SHUFFLED, true, 42);
+
+    /* Each epoch visits every record once. */
+    std::set<int> labels;
+    for (int b = 0; b < 2; ++b) {
+        const Batch& batch = reader.Next();
+        BOOST_CHECK_EQUAL( batch.epoch, 0 );
+        BOOST_REQUIRE_EQUAL( batch.float_data.size(), 5 * 12 );
+        for (int i = 0; i < 5; ++i) {
+            labels.insert(batch.labels[i]);
+            BOOST_CHECK_EQUAL( batch.float_data[i * 12], (float)batch.labels[i] );
+        }
+    }
+    BOOST_CHECK_EQUAL( labels.size(), 10 );
+}
+
+BOOST_AUTO_TEST_CASE(read_float_batches_of_bright_pixels)
+{
+    /* Pixels from 246 to 255 don't fit in a signed char. */
+    shared_ptr<LMDB> db = create_batch_database("test_read_float_batches_of_bright_pixels", 246);
+    BatchReader reader(db.get(), 10, BatchReader::SEQUENTIAL, true);
+
+    const Batch& batch = reader.Next();
+    BOOST_REQUIRE_EQUAL( batch.float_data.size(), 10 * 12 );
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK_EQUAL( batch.float_data[i * 12], 246.0f + i );
+        BOOST_CHECK_EQUAL( batch.float_data[i * 12 + 11], 246.0f + i );
+    }
+}
+
+BOOST_AUTO_TEST_CASE(encoded_database_is_rejected)
+{
+    std::string db_path = databases_folder + "test_encoded_batches";
+    boost::filesystem::remove_all(db_path);
+    LMDB db;
+    db.Open(db_path, LMDB::NEW);
+
+    scoped_ptr<LMDBTransaction> txn(db.NewTransaction(true));
+    caffe::Datum datum;
+    datum.set_encoded(true);
+    datum.set_data("\xff\xd8 not really a JPEG");
+    db.StoreDatum(txn.get(), caffe::format_int(0, 8), &datum);
+    txn->Commit();
+
+    BOOST_CHECK_THROW( BatchReader(&db, 4, BatchReader::SEQUENTIAL), std::runtime_error );
+}
@@ -0,0 +1,86 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <thread>
+
+#include "blocking_queue.hpp"
+
+BOOST_AUTO_TEST_CASE(queue_pop_after_close_drains_items)
+{
+    BlockingQueue<std::string> queue(10, 1000);
+
+    BOOST_CHECK( queue.Push("first", 5) );
+    BOOST_CHECK( queue.Push("second", 6) );
+    queue.Close();
+
+    /* Closed queues don't accept new items. */
+    BOOST_CHECK( ! queue.Push("third", 5) );
+
+    std::string item;
+    BOOST_CHECK( queue.Pop(item) );
+    BOOST_CHECK_EQUAL( item, "first" );
+    BOOST_CHECK( queue.Pop(item) );
+    BOOST_CHECK_EQUAL( item, "second" );
+    BOOST_CHECK( ! queue.Pop(item) );
+}
+
+BOOST_AUTO_TEST_CASE(queue_limits_bytes)
+{
+    BlockingQueue<int> queue(10, 100);
+
+    /* An item larger than the byte limit is accepted in an empty queue. */
+    BOOST_CHECK( queue.Push(1, 150) );
+    BOOST_CHECK_EQUAL( queue.Bytes(), 150 );
+
+    /* The producer blocks until the consumer makes room. */
+    std::thread producer([&queue] { queue.Push(2, 60); queue.Push(3, 30); queue.Close(); });
+
+    int item, sum = 0;
+    while (queue.Pop(item)) {
+        BOOST_CHECK( queue.Bytes() <= 100 );
+        sum += item;
+    }
+    producer.join();
+
+    BOOST_CHECK_EQUAL( sum, 6 );
+    BOOST_CHECK_EQUAL( queue.Size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE(queue_keeps_order_when_growing)
+{
+    BlockingQueue<int> queue(100, 1000);
+    int item;
+
+    /* Wrap around the ring buffer before it grows. */
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK( queue.Push(i, 1) );
+    }
+    for (int i = 0; i < 8; ++i) {
+        BOOST_CHECK( queue.Pop(item) );
+        BOOST_CHECK_EQUAL( item, i );
+    }
+    for (int i = 10; i < 50; ++i) {
+        BOOST_CHECK( queue.Push(i, 1) );
+    }
+    BOOST_CHECK_EQUAL( queue.Size(), 42 );
+    for (int i = 8; i < 50; ++i) {
+        BOOST_CHECK( queue.Pop(item) );
+        BOOST_CHECK_EQUAL( item, i );
+    }
+    BOOST_CHECK_EQUAL( queue.Size(), 0 );
+}
@@ -0,0 +1,74 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include "commit_policy.hpp"
+
+BOOST_AUTO_TEST_CASE(commit_when_batch_reaches_byte_budget)
+{
+    CommitPolicy policy(1000, 0, 0, 100);
+
+    BOOST_CHECK( ! policy.Add(400) );
+    BOOST_CHECK( ! policy.Add(400) );
+    BOOST_CHECK( policy.Add(400) );
+    policy.Committed(1.0, 0.01);
+
+    BOOST_CHECK_EQUAL( policy.NrOfCommits(), 1 );
+    BOOST_CHECK_EQUAL( policy.MaxBatchSize(), 3 );
+    /* Limited by size, not by count, so the batch size didn't change. */
+    BOOST_CHECK_EQUAL( policy.BatchSize(), 100 );
+    BOOST_CHECK_EQUAL( policy.Bytes(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE(commit_batch_size_adapts_to_latency)
+{
+    CommitPolicy policy(0, 0, 1.0, 100);
+
+    /* Commits that take half of the time make the batches larger. */
+    for (int i = 0; i < 99; ++i) {
+        BOOST_CHECK( ! policy.Add(10) );
+    }
+    BOOST_CHECK( policy.Add(10) );
+    policy.Committed(0.5, 0.5);
+    BOOST_CHECK_EQUAL( policy.BatchSize(), 200 );
+
+    /* Commits that are too slow make them smaller again. */
+    for (int i = 0; i < 199; ++i) {
+        BOOST_CHECK( ! policy.Add(10) );
+    }
+    BOOST_CHECK( policy.Add(10) );
+    policy.Committed(1.0, 4.0);
+    BOOST_CHECK_EQUAL( policy.BatchSize(), 50 );
+
+    BOOST_CHECK_EQUAL( policy.NrOfCommits(), 2 );
+    BOOST_CHECK_EQUAL( policy.MinBatchSize(), 100 );
+    BOOST_CHECK_EQUAL( policy.MaxBatchSize(), 200 );
+}
+
+BOOST_AUTO_TEST_CASE(empty_commits_are_not_counted)
+{
+    CommitPolicy policy(15, 0, 0, 100);
+
+    BOOST_CHECK( ! policy.Add(10) );
+    BOOST_CHECK( policy.Add(10) );
+    policy.Committed(0.5, 0.1);
+    /* The final commit after a full batch has nothing left to commit. */
+    policy.Committed(0.01);
+
+    BOOST_CHECK_EQUAL( policy.NrOfCommits(), 1 );
+    BOOST_CHECK_EQUAL( policy.MinBatchSize(), 2 );
+    BOOST_CHECK_EQUAL( policy.MaxBatchSize(), 2 );
+}
@@ -0,0 +1,151 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+#include "lmdb.hpp"
+#include "metadata.hpp"
+#include "db_sync.hpp"
+#include "label_file.hpp"
+
+static const std::string databases_folder = "test/test_working/";
+
+/* A folder with the images a.jpg, b.jpg and c.jpg, and a database with a
+   record for each of them. */
+static void create_synced_database(const std::string& name, bool with_metadata) {
+    std::string root = databases_folder + name + "_images";
+    std::string db_path = databases_folder + name;
+    const char* images[] = { "a.jpg", "b.jpg", "c.jpg" };
+
+    boost::filesystem::remove_all(root);
+    boost::filesystem::remove_all(db_path);
+    boost::filesystem::create_directory(root);
+
+    LMDB db;
+    db.Open(db_path, LMDB::NEW);
+    Metadata metadata;
+    BOOST_REQUIRE( ! with_metadata || metadata.Open(db_path, true) );
+
+    std::vector<std::pair<std::string, SourceInfo> > sources;
+    for (int i = 0; i < 3; ++i) {
+        std::string path = root + "/" + images[i];
+        std::ofstream(path.c_str()) << "image " << i;
+
+        caffe::Datum datum;
+        datum.set_label(i);
+        BOOST_REQUIRE( db.StoreDatum(record_key(i, images[i]), &datum) );
+
+        SourceInfo info;
+        BOOST_REQUIRE( read_source_info(path, i, &info) );
+        sources.push_back(std::make_pair(record_key(i, images[i]), info));
+    }
+    BOOST_REQUIRE( ! with_metadata || metadata.PutSources(sources) );
+}
+
+static void write_label_file(const std::string& path, const char* contents) {
+    std::ofstream(path.c_str()) << contents;
+}
+
+BOOST_AUTO_TEST_CASE(image_path_from_key)
+{
+    BOOST_CHECK_EQUAL( record_key(12, "dir/a_b.jpg"), "00000012_dir/a_b.jpg" );
+    BOOST_CHECK_EQUAL( key_image_path("00000012_dir/a_b.jpg"), "dir/a_b.jpg" );
+    BOOST_CHECK_EQUAL( key_image_path("123456789_a.jpg"), "a.jpg" );
+    BOOST_CHECK( key_image_path("12_a.jpg").empty() );
+    BOOST_CHECK( key_image_path("0000001x_a.jpg").empty() );
+}
+
+BOOST_AUTO_TEST_CASE(sync_added_and_removed_images)
+{
+    create_synced_database("test_sync_added_and_removed", false);
+
+    /* Without metadata, a new label is still seen in the datum. */
+    LabelFile lines;
+    write_label_file(databases_folder + "test_sync_added_and_removed.txt",
+                     "c.jpg 2\na.jpg 5\nd.jpg 3\n");
+    lines.Open(databases_folder + "test_sync_added_and_removed.txt");
+
+    std::vector<std::string> db_names(1, databases_folder + "test_sync_added_and_removed");
+    SyncPlan plan = plan_sync(lines, databases_folder + "test_sync_added_and_removed_images",
+                              db_names);
+
+    BOOST_CHECK_EQUAL( plan.unchanged, 1 );
+    BOOST_REQUIRE_EQUAL( plan.import_lines.size(), 2 );
+    BOOST_CHECK_EQUAL( plan.import_lines[0], 1 );
+    BOOST_CHECK_EQUAL( plan.import_lines[1], 2 );
+    BOOST_CHECK_EQUAL( plan.import_offsets[1], 16 );
+    BOOST_REQUIRE_EQUAL( plan.delete_keys.size(), 1 );
+    BOOST_REQUIRE_EQUAL( plan.delete_keys[0].size(), 2 );
+    BOOST_CHECK_EQUAL( plan.delete_keys[0][0], "00000000_a.jpg" );
+}
+
+BOOST_AUTO_TEST_CASE(sync_changed_images)
+{
+    create_synced_database("test_sync_changed", true);
+    std::string root = databases_folder + "test_sync_changed_images";
+
+    /* b.jpg gets a new label, c.jpg a new size. */
+    std::ofstream((root + "/c.jpg").c_str()) << "a larger image 2";
+
+    LabelFile lines;
+    write_label_file(databases_folder + "test_sync_changed.txt", "a.jpg 0\nb.jpg 4\nc.jpg 2\n");
+    lines.Open(databases_folder + "test_sync_changed.txt");
+
+    std::vector<std::string> db_names(1, databases_folder + "test_sync_changed");
+    SyncPlan plan = plan_sync(lines, root, db_names);
+
+    BOOST_CHECK_EQUAL( plan.unchanged, 1 );
+    BOOST_REQUIRE_EQUAL( plan.import_lines.size(), 2 );
+    BOOST_CHECK_EQUAL( plan.import_lines[0], 1 );
+    BOOST_CHECK_EQUAL( plan.import_lines[1], 2 );
+    BOOST_REQUIRE_EQUAL( plan.delete_keys[0].size(), 2 );
+    BOOST_CHECK_EQUAL( plan.delete_keys[0][0], "00000001_b.jpg" );
+    BOOST_CHECK_EQUAL( plan.delete_keys[0][1], "00000002_c.jpg" );
+}
+
+BOOST_AUTO_TEST_CASE(sync_tracked_sources_without_tracking)
+{
+    create_synced_database("test_sync_tracked", true);
+    std::string root = databases_folder + "test_sync_tracked_images";
+    std::string db_path = databases_folder + "test_sync_tracked";
+    std::ofstream((root + "/b.jpg").c_str()) << "a larger image 1";
+
+    LabelFile lines;
+    write_label_file(databases_folder + "test_sync_tracked.txt", "a.jpg 0\nb.jpg 1\nc.jpg 2\n");
+    lines.Open(databases_folder + "test_sync_tracked.txt");
+    std::vector<std::string> db_names(1, db_path);
+    SyncPlan plan = plan_sync(lines, root, db_names);
+    BOOST_REQUIRE_EQUAL( plan.delete_keys[0].size(), 1 );
+
+    /* Without --track_sources the writer doesn't create metadata, but it
+       still updates the sources it has, like the writer does. */
+    {
+        Metadata metadata;
+        BOOST_REQUIRE( metadata.Open(db_path, false) );
+        BOOST_REQUIRE( metadata.HasSources() );
+        BOOST_CHECK( metadata.DeleteSources(plan.delete_keys[0]) );
+        std::vector<std::pair<std::string, SourceInfo> > sources(1);
+        sources[0].first = record_key(1, "b.jpg");
+        BOOST_REQUIRE( read_source_info(root + "/b.jpg", 1, &sources[0].second) );
+        BOOST_CHECK( metadata.PutSources(sources) );
+    }
+
+    /* The next sync has nothing left to do. */
+    plan = plan_sync(lines, root, db_names);
+    BOOST_CHECK_EQUAL( plan.unchanged, 3 );
+    BOOST_CHECK( plan.import_lines.empty() );
+}
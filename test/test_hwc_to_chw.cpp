@@ -0,0 +1,81 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include "hwc_to_chw.hpp"
+
+static std::vector<uint8_t> test_pixels(size_t size) {
+    std::vector<uint8_t> pixels(size);
+    for (size_t i = 0; i < size; ++i) {
+        pixels[i] = (uint8_t)(i * 7 + i / 251);
+    }
+    return pixels;
+}
+
+BOOST_AUTO_TEST_CASE(hwc_to_chw_scalar)
+{
+    /* 2x2 BGR image. */
+    const uint8_t src[] = { 1, 2, 3,   4, 5, 6,
+                            7, 8, 9,  10, 11, 12 };
+    const uint8_t expected[] = { 1, 4, 7, 10,   2, 5, 8, 11,   3, 6, 9, 12 };
+    uint8_t dst[12];
+
+    hwc_to_chw(src, 6, 2, 2, 3, dst, SIMD_NONE);
+    BOOST_CHECK_EQUAL_COLLECTIONS(dst, dst + 12, expected, expected + 12);
+}
+
+BOOST_AUTO_TEST_CASE(hwc_to_chw_simd_matches_scalar)
+{
+    const int widths[] = { 1, 15, 16, 17, 31, 32, 33, 48, 100, 227 };
+    const int height = 5;
+
+    for (int level = SIMD_NONE; level <= detected_simd_level(); ++level) {
+        for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+            for (int channels = 1; channels <= 4; ++channels) {
+                int width = widths[i];
+                /* Rows padded to check the row step is used. */
+                size_t step = width * channels + 5;
+                std::vector<uint8_t> src = test_pixels(step * height);
+                std::vector<uint8_t> expected(width * height * channels);
+                std::vector<uint8_t> dst(width * height * channels);
+
+                hwc_to_chw(&src[0], step, height, width, channels, &expected[0], SIMD_NONE);
+                hwc_to_chw(&src[0], step, height, width, channels, &dst[0], (SimdLevel)level);
+                BOOST_CHECK_MESSAGE( dst == expected, "level " << level << ", width " << width
+                                     << ", channels " << channels );
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mat_to_datum_planar)
+{
+    std::vector<uint8_t> pixels = test_pixels(37 * 3 * 4);
+    cv::Mat cv_img(4, 37, CV_8UC3, &pixels[0]);
+    caffe::Datum datum;
+
+    mat_to_datum(cv_img, &datum);
+
+    BOOST_CHECK_EQUAL( datum.channels(), 3 );
+    BOOST_CHECK_EQUAL( datum.height(), 4 );
+    BOOST_CHECK_EQUAL( datum.width(), 37 );
+    BOOST_CHECK( ! datum.encoded() );
+    BOOST_REQUIRE_EQUAL( datum.data().size(), pixels.size() );
+    /* Green value of the pixel at row 2, column 5. */
+    BOOST_CHECK_EQUAL( (uint8_t)datum.data()[1 * 4 * 37 + 2 * 37 + 5], pixels[(2 * 37 + 5) * 3 + 1] );
+}
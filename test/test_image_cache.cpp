@@ -0,0 +1,74 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "image_cache.hpp"
+
+static const std::string databases_folder = "test/test_working/";
+static const std::string images_folder = "test/images/";
+
+BOOST_AUTO_TEST_CASE(cache_loaded_images)
+{
+    std::string cache_path = databases_folder + "test_image_cache";
+    std::string source = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    boost::filesystem::remove_all(cache_path);
+
+    ImageOptions options;
+    options.resize_width = 32;
+    options.resize_height = 24;
+    std::string key;
+    {
+        ImageCache cache;
+        cache.Open(cache_path, options, 10 << 20);
+        BOOST_REQUIRE( cache.Key(source, &key) );
+
+        caffe::Datum datum;
+        datum.set_channels(3);
+        datum.set_height(24);
+        datum.set_width(32);
+        datum.set_data(std::string(32 * 24 * 3, 'x'));
+        datum.set_label(1);
+
+        caffe::Datum found;
+        BOOST_CHECK( ! cache.Contains(key) );
+        BOOST_CHECK( ! cache.Get(key, 1, &found) );
+        cache.Put(key, datum);
+        BOOST_CHECK( cache.Flush() );
+        BOOST_CHECK( cache.Contains(key) );
+        BOOST_CHECK_EQUAL( cache.Hits(), 0 );
+        BOOST_CHECK_EQUAL( cache.Misses(), 1 );
+    }
+
+    /* The cache is kept, an image gets the label of the new label file. */
+    ImageCache cache;
+    cache.Open(cache_path, options, 10 << 20);
+    caffe::Datum found;
+    BOOST_REQUIRE( cache.Get(key, 7, &found) );
+    BOOST_CHECK_EQUAL( found.label(), 7 );
+    BOOST_CHECK_EQUAL( found.width(), 32 );
+    BOOST_CHECK_EQUAL( found.data().size(), 32 * 24 * 3 );
+    BOOST_CHECK_EQUAL( cache.Hits(), 1 );
+
+    /* Other options or a missing file give other keys. */
+    ImageCache other;
+    options.resize_width = 64;
+    other.Open(databases_folder + "test_image_cache_other", options, 10 << 20);
+    std::string other_key;
+    BOOST_REQUIRE( other.Key(source, &other_key) );
+    BOOST_CHECK( other_key != key );
+    BOOST_CHECK( ! other.Key(images_folder + "missing.jpg", &other_key) );
+}
@@ -16,12 +16,21 @@
 #include <boost/test/unit_test.hpp>
 
 #define CPU_ONLY
+#ifndef USE_OPENCV
+#define USE_OPENCV
+#endif
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
 
 #include <string>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstdlib>
 #include "boost/shared_ptr.hpp"
 
+#include "image_loader.hpp"
+
 using boost::shared_ptr;
 
 static const std::string images_folder = "test/images/";
@@ -49,4 +58,102 @@ BOOST_AUTO_TEST_CASE(load_jpg_and_resize)
     BOOST_CHECK_EQUAL( data.size(), 260 * 240 * 3 );
 }
 
+BOOST_AUTO_TEST_CASE(load_jpg_encoded_as_is)
+{
+    std::string source = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    ImageOptions options;
+    options.encoded = true;
+    LoadStatistics stats;
+
+    shared_ptr<caffe::Datum> datum = load_image(source, 7, options, &stats);
+
+    /* Without resize the file is stored unchanged. */
+    BOOST_REQUIRE( datum );
+    BOOST_CHECK( datum->encoded() );
+    BOOST_CHECK_EQUAL( datum->label(), 7 );
+    std::ifstream file(source.c_str(), std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    BOOST_CHECK( datum->data() == contents.str() );
+
+    BOOST_CHECK_EQUAL( stats.images, 1 );
+    BOOST_CHECK_EQUAL( stats.bytes_in, contents.str().size() );
+    BOOST_CHECK_EQUAL( stats.bytes_out, datum->ByteSizeLong() );
+}
+
+BOOST_AUTO_TEST_CASE(load_jpg_encoded_and_resize)
+{
+    std::string source = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    ImageOptions options;
+    options.encoded = true;
+    options.resize_width = 64;
+    options.resize_height = 48;
+    options.encode_quality = 80;
+
+    shared_ptr<caffe::Datum> datum = load_image(source, 7, options);
+
+    /* Resized images are encoded again, in the type of the source. */
+    BOOST_REQUIRE( datum );
+    BOOST_CHECK( datum->encoded() );
+    cv::Mat cv_img = caffe::DecodeDatumToCVMat(*datum, true);
+    BOOST_CHECK_EQUAL( cv_img.cols, 64 );
+    BOOST_CHECK_EQUAL( cv_img.rows, 48 );
+    BOOST_CHECK( datum->data().size() < 64 * 48 * 3 );
+}
+
+BOOST_AUTO_TEST_CASE(load_missing_image)
+{
+    ImageOptions options;
+    shared_ptr<caffe::Datum> datum = load_image(images_folder + "missing.jpg", 1, options);
 
+    BOOST_CHECK( ! datum );
+}
+
+BOOST_AUTO_TEST_CASE(jpeg_dimensions_from_header)
+{
+    std::ifstream file((images_folder + "640px-Volga_Estate_Anvers.jpg").c_str(), std::ios::binary);
+    std::vector<unsigned char> buf((std::istreambuf_iterator<char>(file)),
+                                   std::istreambuf_iterator<char>());
+    int width = 0, height = 0;
+
+    BOOST_CHECK( jpeg_dimensions(buf, &width, &height) );
+    BOOST_CHECK_EQUAL( width, 640 );
+    BOOST_CHECK_EQUAL( height, 384 );
+
+    std::vector<unsigned char> not_a_jpeg(100, 0);
+    BOOST_CHECK( ! jpeg_dimensions(not_a_jpeg, &width, &height) );
+}
+
+/* Compare the reduced decoding with a full decode, for every scale. */
+BOOST_AUTO_TEST_CASE(load_jpg_reduced_decode_and_resize)
+{
+    std::string source = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    int sizes[][2] = { { 80, 48 }, { 150, 90 }, { 300, 180 }, { 500, 300 } };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        int width = sizes[s][0], height = sizes[s][1];
+        ImageOptions options;
+        options.resize_width = width;
+        options.resize_height = height;
+
+        options.reduced_decode = false;
+        shared_ptr<caffe::Datum> full = load_image(source, 5, options);
+        options.reduced_decode = true;
+        shared_ptr<caffe::Datum> reduced = load_image(source, 5, options);
+
+        BOOST_REQUIRE( full && reduced );
+        BOOST_CHECK_EQUAL( reduced->channels(), full->channels() );
+        BOOST_CHECK_EQUAL( reduced->height(), height );
+        BOOST_CHECK_EQUAL( reduced->width(), width );
+        BOOST_CHECK_EQUAL( reduced->label(), 5 );
+        BOOST_CHECK( reduced->encoded() == false );
+        BOOST_REQUIRE_EQUAL( reduced->data().size(), full->data().size() );
+
+        double total_diff = 0;
+        for (size_t i = 0; i < full->data().size(); ++i) {
+            total_diff += std::abs((int)(unsigned char)full->data()[i] -
+                                   (int)(unsigned char)reduced->data()[i]);
+        }
+        BOOST_CHECK_LT( total_diff / full->data().size(), 12.0 );
+    }
+}
@@ -0,0 +1,72 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+
+#include "image_statistics.hpp"
+
+/* A 2 x 1 image with 2 channels. */
+static caffe::Datum make_datum(unsigned char a, unsigned char b, unsigned char c,
+                               unsigned char d) {
+    caffe::Datum datum;
+    const char pixels[] = { (char)a, (char)b, (char)c, (char)d };
+    datum.set_channels(2);
+    datum.set_height(1);
+    datum.set_width(2);
+    datum.set_data(std::string(pixels, 4));
+    return datum;
+}
+
+BOOST_AUTO_TEST_CASE(mean_image_and_channel_statistics)
+{
+    ImageStatistics first, second;
+    first.Add(make_datum(0, 10, 100, 200));
+    second.Add(make_datum(20, 30, 255, 255));
+    second.Add(make_datum(40, 50, 0, 0));
+    first.Merge(second);
+
+    BOOST_CHECK_EQUAL( first.NrOfImages(), 3 );
+    BOOST_REQUIRE( first.HasMeanImage() );
+
+    caffe::BlobProto mean;
+    first.MeanImage(&mean);
+    BOOST_CHECK_EQUAL( mean.num(), 1 );
+    BOOST_CHECK_EQUAL( mean.channels(), 2 );
+    BOOST_CHECK_EQUAL( mean.height(), 1 );
+    BOOST_CHECK_EQUAL( mean.width(), 2 );
+    BOOST_REQUIRE_EQUAL( mean.data_size(), 4 );
+    BOOST_CHECK_CLOSE( mean.data(0), 20.0f, 1e-4 );
+    BOOST_CHECK_CLOSE( mean.data(1), 30.0f, 1e-4 );
+    BOOST_CHECK_CLOSE( mean.data(3), 455.0f / 3, 1e-4 );
+
+    /* Channel 0 has pixels 0, 10, 20, 30, 40, 50. */
+    BOOST_CHECK_CLOSE( first.ChannelMean(0), 25.0, 1e-6 );
+    BOOST_CHECK_CLOSE( first.ChannelStd(0), std::sqrt(1750.0 / 6), 1e-6 );
+}
+
+BOOST_AUTO_TEST_CASE(no_mean_image_for_different_sizes)
+{
+    ImageStatistics statistics;
+    caffe::Datum other = make_datum(1, 2, 3, 4);
+    other.set_height(2);
+    other.set_width(1);
+    statistics.Add(make_datum(1, 2, 3, 4));
+    statistics.Add(other);
+
+    BOOST_CHECK_EQUAL( statistics.NrOfImages(), 2 );
+    BOOST_CHECK( ! statistics.HasMeanImage() );
+    BOOST_CHECK_CLOSE( statistics.ChannelMean(1), 3.5, 1e-6 );
+}
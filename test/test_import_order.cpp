@@ -0,0 +1,276 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "blocking_queue.hpp"
+#include "import_order.hpp"
+#include "lmdb.hpp"
+#include "path_index.hpp"
+
+using boost::scoped_ptr;
+using boost::shared_ptr;
+
+static const std::string databases_folder = "test/test_working/";
+
+typedef BlockingQueue<size_t> PositionQueue;
+typedef BlockingQueue<std::pair<size_t, std::string> > KeyQueue;
+
+/* Route the lines of images through nr_of_readers reader threads to the
+   writers of nr_of_shards shards, like the importer does, and return the
+   keys each writer stores, in order. Readers take turns being slow, so
+   they finish their lines out of order. */
+static std::vector<std::vector<std::string> > import_keys(const std::vector<std::string>& images,
+                                                          size_t nr_of_readers,
+                                                          size_t nr_of_shards) {
+    ImportRouting routing(nr_of_readers, nr_of_shards);
+    std::vector<shared_ptr<PositionQueue> > lines;
+    // keys[reader][shard]
+    std::vector<std::vector<shared_ptr<KeyQueue> > > keys(nr_of_readers);
+    for (size_t reader = 0; reader < nr_of_readers; ++reader) {
+        lines.push_back(shared_ptr<PositionQueue>(new PositionQueue(4, 1000)));
+        for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+            keys[reader].push_back(shared_ptr<KeyQueue>(new KeyQueue(4, 1000)));
+        }
+    }
+
+    std::thread parser([&] {
+        for (size_t position = 0; position < images.size(); ++position) {
+            lines[routing.Reader(position)]->Push(position, 1);
+        }
+        for (size_t reader = 0; reader < nr_of_readers; ++reader) {
+            lines[reader]->Close();
+        }
+    });
+    std::vector<std::thread> readers;
+    for (size_t reader = 0; reader < nr_of_readers; ++reader) {
+        readers.push_back(std::thread([&, reader] {
+            size_t position;
+            while (lines[reader]->Pop(position)) {
+                if (position % 5 == reader % 5) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                std::string key;
+                line_key(position, images[position], false, &key);
+                keys[reader][routing.Shard(position)]->Push(std::make_pair(position, key), 1);
+            }
+            for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+                keys[reader][shard]->Close();
+            }
+        }));
+    }
+    std::vector<std::vector<std::string> > stored(nr_of_shards);
+    // Boost.Test checks aren't thread-safe, the writers count instead.
+    std::vector<size_t> out_of_order(nr_of_shards, 0);
+    std::vector<std::thread> writers;
+    for (size_t shard = 0; shard < nr_of_shards; ++shard) {
+        writers.push_back(std::thread([&, shard] {
+            std::pair<size_t, std::string> record;
+            for (size_t position = shard;
+                 keys[routing.Reader(position)][shard]->Pop(record);
+                 position = routing.NextInShard(position)) {
+                out_of_order[shard] += (record.first != position);
+                stored[shard].push_back(record.second);
+            }
+        }));
+    }
+
+    parser.join();
+    for (size_t i = 0; i < readers.size(); ++i) {
+        readers[i].join();
+    }
+    for (size_t i = 0; i < writers.size(); ++i) {
+        writers[i].join();
+        BOOST_CHECK_EQUAL( out_of_order[i], 0 );
+    }
+    return stored;
+}
+
+BOOST_AUTO_TEST_CASE(line_keys)
+{
+    std::string key;
+    line_key(12, "dir/a.jpg", false, &key);
+    BOOST_CHECK_EQUAL( key, "00000012_dir/a.jpg" );
+    line_key(12, "dir/a.jpg", true, &key);
+    BOOST_CHECK_EQUAL( key_line_id(key), 12 );
+}
+
+BOOST_AUTO_TEST_CASE(keys_and_order_independent_of_readers)
+{
+    std::vector<std::string> images;
+    for (size_t i = 0; i < 100; ++i) {
+        images.push_back("image_" + std::to_string(i) + ".jpg");
+    }
+
+    std::vector<std::vector<std::string> > single = import_keys(images, 1, 1);
+    BOOST_REQUIRE_EQUAL( single[0].size(), 100 );
+    for (size_t i = 0; i < 100; ++i) {
+        std::string key;
+        line_key(i, images[i], false, &key);
+        BOOST_CHECK_EQUAL( single[0][i], key );
+    }
+    BOOST_CHECK( import_keys(images, 4, 1) == single );
+    BOOST_CHECK( import_keys(images, 7, 1) == single );
+}
+
+BOOST_AUTO_TEST_CASE(shards_hold_all_lines_once)
+{
+    std::vector<std::string> images, all_keys;
+    for (size_t i = 0; i < 50; ++i) {
+        images.push_back("image_" + std::to_string(i) + ".jpg");
+        all_keys.push_back(std::string());
+        line_key(i, images[i], false, &all_keys.back());
+    }
+
+    std::vector<std::vector<std::string> > shards = import_keys(images, 3, 4);
+    BOOST_REQUIRE_EQUAL( shards.size(), 4 );
+    std::vector<std::string> merged;
+    for (size_t shard = 0; shard < 4; ++shard) {
+        /* Round-robin: shard s holds lines s, s + 4, ... */
+        BOOST_REQUIRE( ! shards[shard].empty() );
+        BOOST_CHECK_EQUAL( shards[shard][0], all_keys[shard] );
+        BOOST_CHECK_EQUAL( shards[shard].size(), (50 - shard + 3) / 4 );
+        merged.insert(merged.end(), shards[shard].begin(), shards[shard].end());
+    }
+    std::sort(merged.begin(), merged.end());
+    BOOST_CHECK( merged == all_keys );
+}
+
+BOOST_AUTO_TEST_CASE(shard_manifest_round_trip)
+{
+    std::string db_name = databases_folder + "test_manifest";
+    BOOST_CHECK_EQUAL( shard_name(db_name, 3), db_name + "_03" );
+
+    std::vector<std::string> shard_names;
+    for (size_t shard = 0; shard < 3; ++shard) {
+        shard_names.push_back(shard_name(db_name, shard));
+        boost::filesystem::remove_all(shard_names[shard]);
+        LMDB db;
+        db.Open(shard_names[shard], LMDB::NEW);
+        scoped_ptr<LMDBTransaction> txn(db.NewTransaction());
+        for (size_t i = 0; i < shard + 1; ++i) {
+            BOOST_CHECK( txn->Put(std::to_string(i), "record") );
+        }
+        BOOST_CHECK( txn->Commit() );
+    }
+    BOOST_REQUIRE( write_shard_manifest(db_name, shard_names, false) );
+
+    ShardManifest manifest;
+    BOOST_REQUIRE( read_shard_manifest(db_name, &manifest) );
+    BOOST_CHECK( manifest.databases == shard_names );
+    BOOST_REQUIRE_EQUAL( manifest.nr_of_records.size(), 3 );
+    for (size_t shard = 0; shard < 3; ++shard) {
+        BOOST_CHECK_EQUAL( manifest.nr_of_records[shard], shard + 1 );
+    }
+    BOOST_CHECK( ! read_shard_manifest(databases_folder + "test_no_manifest", &manifest) );
+}
+
+BOOST_AUTO_TEST_CASE(parse_partitions)
+{
+    size_t part, nr_of_parts;
+    BOOST_CHECK( parse_partition("2/5", &part, &nr_of_parts) );
+    BOOST_CHECK_EQUAL( part, 2 );
+    BOOST_CHECK_EQUAL( nr_of_parts, 5 );
+    BOOST_CHECK( ! parse_partition("5/5", &part, &nr_of_parts) );
+    BOOST_CHECK( ! parse_partition("0/0", &part, &nr_of_parts) );
+    BOOST_CHECK( ! parse_partition("1/2x", &part, &nr_of_parts) );
+}
+
+BOOST_AUTO_TEST_CASE(shuffle_seed_gives_same_order)
+{
+    std::vector<size_t> permutation = shuffled_positions(1000, 42);
+    BOOST_CHECK( shuffled_positions(1000, 42) == permutation );
+    BOOST_CHECK( shuffled_positions(1000, 43) != permutation );
+
+    std::vector<size_t> sorted(permutation);
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t position = 0; position < sorted.size(); ++position) {
+        BOOST_CHECK_EQUAL( sorted[position], position );
+    }
+}
+
+// Line i of the label file is at offset 100 * i.
+static std::vector<std::pair<uint64_t, size_t> > ordered_lines(const ImportOrderOptions& options,
+                                                               size_t nr_of_lines) {
+    std::vector<uint64_t> all_offsets, offsets;
+    std::vector<size_t> line_numbers;
+    for (size_t i = 0; i < nr_of_lines; ++i) {
+        all_offsets.push_back(100 * i);
+    }
+    import_order(all_offsets, options, &offsets, &line_numbers);
+    BOOST_REQUIRE_EQUAL( offsets.size(), line_numbers.size() );
+
+    std::vector<std::pair<uint64_t, size_t> > lines;
+    for (size_t position = 0; position < offsets.size(); ++position) {
+        lines.push_back(std::make_pair(offsets[position], line_numbers[position]));
+    }
+    return lines;
+}
+
+BOOST_AUTO_TEST_CASE(shuffled_import_order)
+{
+    ImportOrderOptions options;
+    options.shuffle = true;
+    options.shuffle_seed = 7;
+    std::vector<size_t> permutation = shuffled_positions(50, 7);
+
+    // The lines are read in random order, each under the key of its position.
+    std::vector<std::pair<uint64_t, size_t> > lines = ordered_lines(options, 50);
+    BOOST_REQUIRE_EQUAL( lines.size(), 50 );
+    for (size_t position = 0; position < 50; ++position) {
+        BOOST_CHECK_EQUAL( lines[position].first, 100 * permutation[position] );
+        BOOST_CHECK_EQUAL( lines[position].second, position );
+    }
+    BOOST_CHECK( ordered_lines(options, 50) == lines );
+
+    // The lines are read in file order, under shuffled keys.
+    options.shuffle_keys = true;
+    lines = ordered_lines(options, 50);
+    BOOST_REQUIRE_EQUAL( lines.size(), 50 );
+    for (size_t position = 0; position < 50; ++position) {
+        BOOST_CHECK_EQUAL( lines[position].first, 100 * position );
+        BOOST_CHECK_EQUAL( lines[position].second, permutation[position] );
+    }
+}
+
+BOOST_AUTO_TEST_CASE(partitions_have_keys_of_full_import)
+{
+    for (int mode = 0; mode < 3; ++mode) {
+        ImportOrderOptions options;
+        options.shuffle = mode > 0;
+        options.shuffle_keys = mode > 1;
+        options.shuffle_seed = 3;
+        std::vector<std::pair<uint64_t, size_t> > full = ordered_lines(options, 101);
+
+        std::vector<std::pair<uint64_t, size_t> > parts;
+        options.nr_of_parts = 4;
+        for (options.part = 0; options.part < options.nr_of_parts; ++options.part) {
+            std::vector<std::pair<uint64_t, size_t> > part = ordered_lines(options, 101);
+            BOOST_CHECK( part.size() >= 25 && part.size() <= 26 );
+            parts.insert(parts.end(), part.begin(), part.end());
+        }
+        BOOST_CHECK( parts == full );
+    }
+}
@@ -0,0 +1,113 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+
+#include "label_file.hpp"
+
+static const std::string databases_folder = "test/test_working/";
+
+static std::string write_label_file(const std::string& name, const std::string& contents) {
+    std::string path = databases_folder + name;
+    std::ofstream(path.c_str()) << contents;
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(parse_label_file)
+{
+    LabelFile label_file;
+    label_file.Open(write_label_file("test_parse_label_file.txt",
+                                     "dir/a b.jpg 3\n\nc.jpg -1\nd.jpg 12"));
+    boost::string_ref path;
+    int label;
+    uint64_t offset = 0;
+
+    BOOST_CHECK_EQUAL( label_file.CountLines(), 4 );
+    BOOST_REQUIRE( label_file.NextLine(&offset, &path, &label) );
+    BOOST_CHECK_EQUAL( path, "dir/a b.jpg" );
+    BOOST_CHECK_EQUAL( label, 3 );
+    /* The empty line counts, so the lines are numbered as in the file. */
+    BOOST_REQUIRE( label_file.NextLine(&offset, &path, &label) );
+    BOOST_CHECK( path.empty() );
+    BOOST_REQUIRE( label_file.NextLine(&offset, &path, &label) );
+    BOOST_CHECK_EQUAL( path, "c.jpg" );
+    BOOST_CHECK_EQUAL( label, -1 );
+    /* The last line has no newline. */
+    BOOST_REQUIRE( label_file.NextLine(&offset, &path, &label) );
+    BOOST_CHECK_EQUAL( path, "d.jpg" );
+    BOOST_CHECK_EQUAL( label, 12 );
+    BOOST_CHECK( ! label_file.NextLine(&offset, &path, &label) );
+
+    std::vector<uint64_t> offsets;
+    label_file.BuildIndex(&offsets);
+    BOOST_CHECK_EQUAL( offsets.size(), 4 );
+}
+
+BOOST_AUTO_TEST_CASE(label_file_index)
+{
+    LabelFile label_file;
+    label_file.Open(write_label_file("test_label_file_index.txt", "a.jpg 0\nbb.jpg 1\nccc.jpg 2\n"));
+    std::vector<uint64_t> offsets;
+    boost::string_ref path;
+    int label;
+
+    label_file.BuildIndex(&offsets);
+    BOOST_REQUIRE_EQUAL( offsets.size(), 3 );
+    BOOST_CHECK_EQUAL( offsets[2], 17 );
+    label_file.LineAt(offsets[1], &path, &label);
+    BOOST_CHECK_EQUAL( path, "bb.jpg" );
+    BOOST_CHECK_EQUAL( label, 1 );
+
+    std::vector<std::pair<std::string, int> > samples = label_file.Sample(16);
+    BOOST_CHECK_EQUAL( samples.size(), 3 );
+    BOOST_CHECK_EQUAL( samples[0].first, "a.jpg" );
+}
+
+BOOST_AUTO_TEST_CASE(empty_label_file)
+{
+    LabelFile label_file;
+    label_file.Open(write_label_file("test_empty_label_file.txt", ""));
+    uint64_t offset = 0;
+    boost::string_ref path;
+    int label;
+
+    BOOST_CHECK_EQUAL( label_file.CountLines(), 0 );
+    BOOST_CHECK( ! label_file.NextLine(&offset, &path, &label) );
+    BOOST_CHECK( label_file.Sample(16).empty() );
+}
+
+BOOST_AUTO_TEST_CASE(label_file_hash)
+{
+    /* Large enough to be hashed in blocks. */
+    std::string lines;
+    for (size_t i = 0; lines.size() < (4 << 20); ++i) {
+        lines += "images/image_" + std::to_string(i) + ".jpg " + std::to_string(i % 10) + "\n";
+    }
+    LabelFile label_file, same_file, other_end, other_size, small_file, other_small_file;
+    label_file.Open(write_label_file("test_hash.txt", lines));
+    same_file.Open(write_label_file("test_hash_same.txt", lines));
+    std::string changed(lines);
+    changed[changed.size() - 2] = 'x';
+    other_end.Open(write_label_file("test_hash_other_end.txt", changed));
+    other_size.Open(write_label_file("test_hash_other_size.txt", lines + "a.jpg 1\n"));
+    small_file.Open(write_label_file("test_hash_small.txt", "a.jpg 1\nb.jpg 2\n"));
+    other_small_file.Open(write_label_file("test_hash_other_small.txt", "a.jpg 1\nb.jpg 3\n"));
+
+    BOOST_CHECK_EQUAL( label_file.Hash(), same_file.Hash() );
+    BOOST_CHECK( label_file.Hash() != other_end.Hash() );
+    BOOST_CHECK( label_file.Hash() != other_size.Hash() );
+    BOOST_CHECK( small_file.Hash() != other_small_file.Hash() );
+}
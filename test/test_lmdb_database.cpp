@@ -154,3 +154,159 @@ BOOST_AUTO_TEST_CASE(import_multiple_images_in_database_single_transaction)
     db->Close();
     /*    ...     */
 }
+
+BOOST_AUTO_TEST_CASE(append_keys_out_of_order)
+{
+    bool success;
+
+    shared_ptr<LMDB> db = open_test_database("test_append_keys_out_of_order");
+
+    /* Append mode falls back to regular puts when a key is out of order. */
+    scoped_ptr<LMDBTransaction> txn(db->NewTransaction(true));
+
+    success = txn->Put(caffe::format_int(1, 8), "first");
+    BOOST_CHECK( success );
+    success = txn->Put(caffe::format_int(3, 8), "third");
+    BOOST_CHECK( success );
+    success = txn->Put(caffe::format_int(2, 8), "second");
+    BOOST_CHECK( success );
+
+    txn->Commit();
+    BOOST_CHECK_EQUAL(db->NrOfEntries(), 3);
+
+    db->Close();
+}
+
+BOOST_AUTO_TEST_CASE(grow_map_when_full)
+{
+    std::string db_path = databases_folder + "test_grow_map_when_full";
+    boost::filesystem::remove_all(db_path);
+
+    /* Start with a map that can't hold 64 records of 4 KB. */
+    LMDB::Options options;
+    options.map_size = 64 * 1024;
+    shared_ptr<LMDB> db(new LMDB());
+    db->Open(db_path, LMDB::NEW, options);
+    BOOST_CHECK_EQUAL(db->MapSize(), 64 * 1024);
+
+    std::string value(4096, 'x');
+    scoped_ptr<LMDBTransaction> txn(db->NewTransaction(true));
+    int stored = 0;
+    for (int i = 0; i < 64; ++i) {
+        if (! txn->Put(caffe::format_int(i, 8), value)) {
+            BOOST_REQUIRE( txn->MapFull() );
+
+            /* Grow the map and store all records of the batch again. */
+            txn->Abort();
+            BOOST_REQUIRE( db->GrowMapSize() );
+            txn.reset(db->NewTransaction(true));
+            for (int j = 0; j < i; ++j) {
+                BOOST_REQUIRE( txn->Put(caffe::format_int(j, 8), value) );
+            }
+            --i;
+            continue;
+        }
+        stored = i + 1;
+    }
+    BOOST_CHECK( txn->Commit() );
+    BOOST_CHECK_EQUAL(stored, 64);
+    BOOST_CHECK_EQUAL(db->NrOfEntries(), 64);
+    BOOST_CHECK( db->MapSize() > 64 * 1024 );
+
+    db->Close();
+}
+
+BOOST_AUTO_TEST_CASE(fast_import_synced_on_close)
+{
+    bool success;
+    scoped_ptr<caffe::Datum> datum(new caffe::Datum());
+
+    std::string db_path = databases_folder + "test_fast_import_synced_on_close";
+    boost::filesystem::remove_all(db_path);
+
+    bool is_color = true; std::string encode_type = "";
+    std::string image = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    success = ReadImageToDatum(image, 123456, 256, 256, is_color,
+                               encode_type, datum.get());
+    BOOST_CHECK( success );
+
+    LMDB::Options options;
+    options.fast_import = true;
+    shared_ptr<LMDB> db(new LMDB());
+    db->Open(db_path, LMDB::NEW, options);
+
+    scoped_ptr<LMDBTransaction> txn(db->NewTransaction(true));
+    for (int i = 0; i < 10; ++i) {
+        success = db->StoreDatum(txn.get(), caffe::format_int(i, 8), datum.get());
+        BOOST_CHECK( success );
+    }
+    BOOST_CHECK( txn->Commit() );
+    db->Close();
+
+    /* All records are on disk after closing. */
+    db.reset(new LMDB());
+    db->Open(db_path, LMDB::READ);
+    BOOST_CHECK_EQUAL(db->NrOfEntries(), 10);
+    db->Close();
+}
+
+BOOST_AUTO_TEST_CASE(read_records_with_cursor)
+{
+    bool success;
+    bool is_color = true;
+    std::string encode_type = "";
+
+    shared_ptr<LMDB> db = open_test_database("test_read_records_with_cursor");
+
+    /* Store 5 images with different labels. */
+    scoped_ptr<caffe::Datum> datum(new caffe::Datum());
+    std::string image = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    scoped_ptr<LMDBTransaction> txn(db->NewTransaction(true));
+    for (int i = 0; i < 5; ++i) {
+        success = ReadImageToDatum(image, i, 32, 32, is_color, encode_type, datum.get());
+        BOOST_CHECK( success );
+        success = db->StoreDatum(txn.get(), caffe::format_int(i, 8), datum.get());
+        BOOST_CHECK( success );
+    }
+    BOOST_CHECK( txn->Commit() );
+
+    scoped_ptr<LMDBReadTransaction> read_txn(db->NewReadTransaction());
+    BOOST_REQUIRE( read_txn );
+
+    /* Lookup by key */
+    boost::string_ref value;
+    BOOST_CHECK( read_txn->Get(caffe::format_int(3, 8), &value) );
+    BOOST_CHECK( read_txn->GetDatum(caffe::format_int(3, 8), datum.get()) );
+    BOOST_CHECK_EQUAL( datum->label(), 3 );
+    BOOST_CHECK_EQUAL( datum->ByteSizeLong(), value.size() );
+    BOOST_CHECK( ! read_txn->Get(caffe::format_int(7, 8), &value) );
+
+    /* Full scan */
+    int count = 0;
+    {
+        scoped_ptr<LMDBCursor> cursor(read_txn->NewCursor());
+        for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+            BOOST_CHECK( cursor->ParseDatum(datum.get()) );
+            BOOST_CHECK_EQUAL( datum->label(), count );
+            BOOST_CHECK_EQUAL( datum->data().size(), 32 * 32 * 3 );
+            count ++;
+        }
+    }
+    BOOST_CHECK_EQUAL( count, 5 );
+
+    /* Range scan over [1, 4) */
+    {
+        scoped_ptr<LMDBCursor> cursor(read_txn->NewCursor());
+        cursor->SetEnd(caffe::format_int(4, 8));
+        BOOST_CHECK( cursor->Seek(caffe::format_int(1, 8)) );
+        BOOST_CHECK_EQUAL( cursor->Key(), caffe::format_int(1, 8) );
+        count = 0;
+        for (; cursor->Valid(); cursor->Next()) {
+            count ++;
+        }
+        BOOST_CHECK_EQUAL( count, 3 );
+    }
+
+    read_txn.reset();
+    db->Close();
+}
@@ -0,0 +1,174 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "lmdb.hpp"
+#include "merge.hpp"
+#include "path_index.hpp"
+
+using boost::scoped_ptr;
+
+static const std::string databases_folder = "test/test_working/";
+
+/* Create a database with a record with value key for each key. */
+static void create_database(const std::string& db_path, const std::vector<std::string>& keys,
+                            bool integer_keys = false)
+{
+    boost::filesystem::remove_all(db_path);
+
+    LMDB::Options options;
+    options.integer_keys = integer_keys;
+    options.max_dbs = integer_keys ? 2 : 0;
+    LMDB db;
+    db.Open(db_path, LMDB::NEW, options);
+    PathIndex index;
+    BOOST_REQUIRE( ! integer_keys || index.Open(&db, true) );
+
+    scoped_ptr<LMDBTransaction> txn(db.NewTransaction());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        BOOST_CHECK( txn->Put(keys[i], db_path + ":" + keys[i]) );
+        if (integer_keys) {
+            std::string image_path = "image_" + std::to_string(key_line_id(keys[i])) + ".jpg";
+            BOOST_CHECK( index.Put(txn.get(), keys[i], image_path) );
+        }
+    }
+    BOOST_CHECK( txn->Commit() );
+}
+
+BOOST_AUTO_TEST_CASE(merge_databases_in_key_order)
+{
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < 3; ++i) {
+        inputs.push_back(databases_folder + "test_merge_input_" + std::to_string(i));
+    }
+    std::string output = databases_folder + "test_merge_output";
+    boost::filesystem::remove_all(output);
+
+    create_database(inputs[0], { "00000000_a.jpg", "00000003_d.jpg", "00000006_g.jpg" });
+    create_database(inputs[1], { "00000001_b.jpg", "00000004_e.jpg" });
+    create_database(inputs[2], { "00000002_c.jpg", "00000003_d.jpg", "00000005_f.jpg" });
+
+    /* Commit after every record. */
+    MergeOptions options;
+    options.commit_bytes = 1;
+    MergeStatistics stats;
+    BOOST_REQUIRE( merge_databases(inputs, output, options, &stats) );
+    BOOST_CHECK_EQUAL( stats.records, 7 );
+    BOOST_CHECK_EQUAL( stats.duplicates, 1 );
+
+    LMDB db;
+    db.Open(output, LMDB::READ);
+    BOOST_CHECK_EQUAL( db.NrOfEntries(), 7 );
+    scoped_ptr<LMDBReadTransaction> txn(db.NewReadTransaction());
+    scoped_ptr<LMDBCursor> cursor(txn->NewCursor());
+    size_t count = 0;
+    for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+        BOOST_CHECK_EQUAL( cursor->Key().substr(0, 8), "0000000" + std::to_string(count) );
+        count ++;
+    }
+    BOOST_CHECK_EQUAL( count, 7 );
+
+    /* A duplicate key keeps the record of the first input. */
+    boost::string_ref value;
+    BOOST_CHECK( txn->Get("00000003_d.jpg", &value) );
+    BOOST_CHECK_EQUAL( value, inputs[0] + ":00000003_d.jpg" );
+
+    /* The output isn't overwritten. */
+    BOOST_CHECK( ! merge_databases(inputs, output, options, &stats) );
+}
+
+BOOST_AUTO_TEST_CASE(merge_databases_with_integer_keys)
+{
+    std::vector<std::string> inputs;
+    inputs.push_back(databases_folder + "test_merge_integer_input_0");
+    inputs.push_back(databases_folder + "test_merge_integer_input_1");
+    std::string output = databases_folder + "test_merge_integer_output";
+    boost::filesystem::remove_all(output);
+
+    /* 256 comes before 2 in byte order, not as a number. */
+    create_database(inputs[0], { integer_key(1), integer_key(256) }, true);
+    create_database(inputs[1], { integer_key(2), integer_key(70000) }, true);
+
+    MergeOptions options;
+    options.integer_keys = true;
+    MergeStatistics stats;
+    BOOST_REQUIRE( merge_databases(inputs, output, options, &stats) );
+    BOOST_CHECK_EQUAL( stats.records, 4 );
+
+    LMDB::Options db_options;
+    db_options.integer_keys = true;
+    db_options.max_dbs = 2;
+    LMDB db;
+    db.Open(output, LMDB::READ, db_options);
+    PathIndex index;
+    BOOST_REQUIRE( index.Open(&db, false) );
+    scoped_ptr<LMDBReadTransaction> txn(db.NewReadTransaction());
+
+    const size_t line_ids[] = { 1, 2, 256, 70000 };
+    {
+        scoped_ptr<LMDBCursor> cursor(txn->NewCursor());
+        size_t count = 0;
+        for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+            BOOST_CHECK_EQUAL( key_line_id(cursor->Key()), line_ids[count] );
+            count ++;
+        }
+        BOOST_CHECK_EQUAL( count, 4 );
+    }
+
+    boost::string_ref value;
+    BOOST_CHECK( index.ImagePath(txn.get(), integer_key(70000), &value) );
+    BOOST_CHECK_EQUAL( value, "image_70000.jpg" );
+    BOOST_CHECK( index.Key(txn.get(), "image_256.jpg", &value) );
+    BOOST_CHECK_EQUAL( key_line_id(value), 256 );
+}
+
+BOOST_AUTO_TEST_CASE(failed_merge_removes_output)
+{
+    std::vector<std::string> inputs;
+    inputs.push_back(databases_folder + "test_merge_failing_input_0");
+    inputs.push_back(databases_folder + "test_merge_failing_input_1");
+    std::string output = databases_folder + "test_merge_failing_output";
+    boost::filesystem::remove_all(output);
+
+    /* The second input has integer keys but no index of the image paths, so
+       the merge fails after the records were merged. */
+    create_database(inputs[0], { integer_key(1) }, true);
+    boost::filesystem::remove_all(inputs[1]);
+    {
+        LMDB::Options db_options;
+        db_options.integer_keys = true;
+        db_options.max_dbs = 2;
+        LMDB db;
+        db.Open(inputs[1], LMDB::NEW, db_options);
+        scoped_ptr<LMDBTransaction> txn(db.NewTransaction());
+        BOOST_CHECK( txn->Put(integer_key(2), "record") );
+        BOOST_CHECK( txn->Commit() );
+    }
+
+    MergeOptions options;
+    options.integer_keys = true;
+    MergeStatistics stats;
+    BOOST_CHECK( ! merge_databases(inputs, output, options, &stats) );
+    BOOST_CHECK( ! boost::filesystem::exists(output) );
+
+    /* A missing input doesn't create the output either. */
+    inputs.push_back(databases_folder + "test_merge_missing_input");
+    boost::filesystem::remove_all(inputs.back());
+    BOOST_CHECK( ! merge_databases(inputs, output, options, &stats) );
+    BOOST_CHECK( ! boost::filesystem::exists(output) );
+}
@@ -0,0 +1,71 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "lmdb.hpp"
+#include "metadata.hpp"
+
+static const std::string databases_folder = "test/test_working/";
+
+BOOST_AUTO_TEST_CASE(checkpoint_serialization)
+{
+    Checkpoint checkpoint, parsed;
+    checkpoint.next_line = 3200001;
+    checkpoint.label_hash = 0xfedcba9876543210ULL;
+    checkpoint.settings = "root_folder=images/ resize=256x256 shards=4";
+
+    BOOST_REQUIRE( parsed.Parse(checkpoint.Serialize()) );
+    BOOST_CHECK_EQUAL( parsed.next_line, checkpoint.next_line );
+    BOOST_CHECK_EQUAL( parsed.label_hash, checkpoint.label_hash );
+    BOOST_CHECK_EQUAL( parsed.settings, checkpoint.settings );
+    BOOST_CHECK( ! parsed.Parse("garbage") );
+}
+
+BOOST_AUTO_TEST_CASE(store_checkpoint_with_sources)
+{
+    std::string db_path = databases_folder + "test_store_checkpoint";
+    boost::filesystem::remove_all(db_path);
+    boost::filesystem::create_directory(db_path);
+
+    {
+        Metadata metadata;
+        Checkpoint checkpoint;
+        BOOST_REQUIRE( metadata.Open(db_path, true) );
+        BOOST_CHECK( ! metadata.ReadCheckpoint(&checkpoint) );
+        BOOST_CHECK( ! metadata.HasSources() );
+
+        std::vector<std::pair<std::string, SourceInfo> > sources(1);
+        sources[0].first = record_key(0, "a.jpg");
+        sources[0].second.label = 7;
+        checkpoint.next_line = 1;
+        checkpoint.settings = "shards=1";
+        BOOST_REQUIRE( metadata.PutCheckpoint(checkpoint, sources) );
+        checkpoint.next_line = 5;
+        BOOST_REQUIRE( metadata.PutCheckpoint(checkpoint, std::vector<std::pair<std::string, SourceInfo> >()) );
+    }
+
+    Metadata metadata;
+    Checkpoint checkpoint;
+    std::map<std::string, SourceInfo> sources;
+    BOOST_REQUIRE( metadata.Open(db_path, false) );
+    BOOST_REQUIRE( metadata.ReadCheckpoint(&checkpoint) );
+    BOOST_CHECK_EQUAL( checkpoint.next_line, 5 );
+    BOOST_CHECK_EQUAL( checkpoint.settings, "shards=1" );
+    BOOST_REQUIRE( metadata.ReadSources(&sources) );
+    BOOST_REQUIRE_EQUAL( sources.size(), 1 );
+    BOOST_CHECK_EQUAL( sources["00000000_a.jpg"].label, 7 );
+}
@@ -0,0 +1,117 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "lmdb.hpp"
+#include "path_index.hpp"
+
+using boost::scoped_ptr;
+
+static const std::string databases_folder = "test/test_working/";
+
+BOOST_AUTO_TEST_CASE(integer_key_round_trip)
+{
+    BOOST_CHECK_EQUAL( integer_key(12345).size(), sizeof(size_t) );
+    BOOST_CHECK_EQUAL( key_line_id(integer_key(12345)), 12345 );
+    BOOST_CHECK_EQUAL( key_line_id("00000001_image.jpg"), SIZE_MAX );
+}
+
+BOOST_AUTO_TEST_CASE(store_records_with_integer_keys)
+{
+    std::string db_path = databases_folder + "test_integer_keys";
+    boost::filesystem::remove_all(db_path);
+
+    LMDB::Options options;
+    options.integer_keys = true;
+    options.max_dbs = 2;
+    LMDB db;
+    db.Open(db_path, LMDB::NEW, options);
+    PathIndex index;
+    BOOST_REQUIRE( index.Open(&db, true) );
+
+    /* 2 comes after 256 in byte order, not as a number. */
+    const size_t line_ids[] = { 1, 2, 256, 70000 };
+    scoped_ptr<LMDBTransaction> txn(db.NewTransaction(true));
+    for (size_t i = 0; i < 4; ++i) {
+        caffe::Datum datum;
+        datum.set_label(i);
+        std::string key = integer_key(line_ids[i]);
+        BOOST_CHECK( txn->PutDatum(key, datum) );
+        BOOST_CHECK( index.Put(txn.get(), key, "images/image_" + std::to_string(i) + ".jpg") );
+    }
+    BOOST_CHECK( txn->Commit() );
+    BOOST_CHECK_EQUAL( db.NrOfEntries(), 4 );
+
+    scoped_ptr<LMDBReadTransaction> read_txn(db.NewReadTransaction());
+    BOOST_REQUIRE( read_txn );
+
+    /* The records are in numeric order, also for a range scan. */
+    {
+        scoped_ptr<LMDBCursor> cursor(read_txn->NewCursor());
+        cursor->SetEnd(integer_key(70000));
+        size_t count = 0;
+        for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+            BOOST_CHECK_EQUAL( key_line_id(cursor->Key()), line_ids[count] );
+            count ++;
+        }
+        BOOST_CHECK_EQUAL( count, 3 );
+    }
+
+    boost::string_ref value;
+    BOOST_CHECK( index.ImagePath(read_txn.get(), integer_key(256), &value) );
+    BOOST_CHECK_EQUAL( value, "images/image_2.jpg" );
+    BOOST_CHECK( index.Key(read_txn.get(), "images/image_3.jpg", &value) );
+    BOOST_CHECK_EQUAL( key_line_id(value), 70000 );
+    BOOST_CHECK( ! index.Key(read_txn.get(), "images/missing.jpg", &value) );
+}
+
+BOOST_AUTO_TEST_CASE(index_long_image_paths)
+{
+    std::string db_path = databases_folder + "test_long_paths";
+    boost::filesystem::remove_all(db_path);
+
+    LMDB::Options options;
+    options.integer_keys = true;
+    options.max_dbs = 2;
+    LMDB db;
+    db.Open(db_path, LMDB::NEW, options);
+    PathIndex index;
+    BOOST_REQUIRE( index.Open(&db, true) );
+
+    /* Longer than the 511 bytes LMDB allows in a key. */
+    std::string long_path = "images/" + std::string(600, 'a') + ".jpg";
+    std::string other_path = "images/" + std::string(600, 'a') + ".png";
+    BOOST_CHECK_EQUAL( path_hash(long_path).size(), 8 );
+    BOOST_CHECK( path_hash(long_path) != path_hash(other_path) );
+
+    scoped_ptr<LMDBTransaction> txn(db.NewTransaction());
+    BOOST_CHECK( index.Put(txn.get(), integer_key(1), long_path) );
+    BOOST_CHECK( index.Put(txn.get(), integer_key(2), other_path) );
+    /* An image listed again maps to its last key. */
+    BOOST_CHECK( index.Put(txn.get(), integer_key(3), long_path) );
+    BOOST_CHECK( txn->Commit() );
+
+    scoped_ptr<LMDBReadTransaction> read_txn(db.NewReadTransaction());
+    boost::string_ref value;
+    BOOST_CHECK( index.Key(read_txn.get(), long_path, &value) );
+    BOOST_CHECK_EQUAL( key_line_id(value), 3 );
+    BOOST_CHECK( index.Key(read_txn.get(), other_path, &value) );
+    BOOST_CHECK_EQUAL( key_line_id(value), 2 );
+    BOOST_CHECK( index.ImagePath(read_txn.get(), integer_key(1), &value) );
+    BOOST_CHECK_EQUAL( value, long_path );
+}
@@ -0,0 +1,75 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+#include "pipeline_metrics.hpp"
+
+BOOST_AUTO_TEST_CASE(latency_histogram_percentiles)
+{
+    LatencyHistogram histogram;
+
+    /* 90 fast and 10 slow latencies. */
+    for (int i = 0; i < 90; ++i) {
+        histogram.Add(0.0001);
+    }
+    for (int i = 0; i < 10; ++i) {
+        histogram.Add(0.1);
+    }
+
+    BOOST_CHECK_EQUAL( histogram.Count(), 100 );
+    BOOST_CHECK_CLOSE( histogram.TotalSeconds(), 1.009, 0.1 );
+    BOOST_CHECK_CLOSE( histogram.MaxSeconds(), 0.1, 0.1 );
+    /* 100 us falls in the bucket up to 128 us. The bucket of 100 ms goes up
+       to 131 ms, beyond the largest latency. */
+    BOOST_CHECK_CLOSE( histogram.Percentile(50), 128e-6, 0.1 );
+    BOOST_CHECK_CLOSE( histogram.Percentile(90), 128e-6, 0.1 );
+    BOOST_CHECK_CLOSE( histogram.Percentile(99), 0.1, 0.1 );
+}
+
+BOOST_AUTO_TEST_CASE(pipeline_metrics_report)
+{
+    PipelineMetrics metrics(4);
+
+    ThreadMetrics* reader = metrics.AddThread("reader 0");
+    reader->Busy(1.5);
+    reader->Idle(0.5);
+    metrics.AddLatency(PipelineMetrics::DECODE, 0.01);
+    metrics.AddImage(1000);
+    metrics.AddImage(0);
+    metrics.AddMapResize(1 << 20);
+    metrics.AddQueueSample(1, 2, 3000);
+
+    BOOST_CHECK( metrics.Progress().find("Processed 2 of 4 files (50%)") == 0 );
+
+    std::vector<std::string> summary = metrics.Summary();
+    BOOST_REQUIRE_EQUAL( summary.size(), PipelineMetrics::NR_OF_STAGES + 1 );
+    BOOST_CHECK_EQUAL( summary.back(), "reader 0: busy 1.50 s, waiting 0.50 s (75.0% busy)." );
+
+    std::ostringstream json;
+    metrics.WriteJson(json);
+    BOOST_CHECK( json.str().find("\"images\": {\"total\": 4, \"processed\": 2, \"stored\": 1}")
+                 != std::string::npos );
+    BOOST_CHECK( json.str().find("\"bytes_written\": 1000") != std::string::npos );
+    BOOST_CHECK( json.str().find("\"decode\": {\"count\": 1") != std::string::npos );
+    BOOST_CHECK( json.str().find("\"map_size\": 1048576") != std::string::npos );
+    BOOST_CHECK( json.str().find("\"datum_bytes\": 3000") != std::string::npos );
+
+    /* Stop wakes up the progress thread. */
+    BOOST_CHECK( ! metrics.WaitForStop(0.001) );
+    metrics.Stop();
+    BOOST_CHECK( metrics.WaitForStop(10) );
+}
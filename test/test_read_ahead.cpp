@@ -0,0 +1,77 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "read_ahead.hpp"
+#include "image_loader.hpp"
+
+static const std::string images_folder = "test/images/";
+
+BOOST_AUTO_TEST_CASE(read_whole_file)
+{
+    std::string image = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    std::ifstream file(image.c_str(), std::ios::binary);
+    std::vector<unsigned char> expected((std::istreambuf_iterator<char>(file)),
+                                        std::istreambuf_iterator<char>());
+    std::vector<unsigned char> contents;
+
+    BOOST_REQUIRE( read_file(image, &contents) );
+    BOOST_CHECK( contents == expected );
+    BOOST_CHECK( ! read_file(images_folder + "missing.jpg", &contents) );
+}
+
+BOOST_AUTO_TEST_CASE(read_files_ahead)
+{
+    std::string image = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    std::vector<unsigned char> expected;
+    BOOST_REQUIRE( read_file(image, &expected) );
+
+    ReadAhead read_ahead(2, 3);
+    for (int round = 0; round < 4; ++round) {
+        /* Holds at most max_files reads, Read would block on a fourth. */
+        std::vector<shared_ptr<FileRead> > reads;
+        reads.push_back(read_ahead.Read(image));
+        reads.push_back(read_ahead.Read(images_folder + "missing.jpg"));
+        reads.push_back(read_ahead.Read(image));
+
+        BOOST_CHECK( reads[0]->Wait() );
+        BOOST_CHECK( reads[0]->Contents() == expected );
+        BOOST_CHECK( ! reads[1]->Wait() );
+        BOOST_CHECK( reads[2]->Wait() );
+        BOOST_CHECK_EQUAL( reads[2]->Path(), image );
+    }
+}
+
+BOOST_AUTO_TEST_CASE(load_image_from_memory)
+{
+    std::string image = images_folder + "640px-Volga_Estate_Anvers.jpg";
+    std::vector<unsigned char> contents;
+    BOOST_REQUIRE( read_file(image, &contents) );
+
+    ImageOptions options;
+    options.resize_width = 64;
+    options.resize_height = 48;
+    shared_ptr<caffe::Datum> from_file = load_image(image, 3, options);
+    shared_ptr<caffe::Datum> from_memory = load_image(image, contents, 3, options);
+
+    BOOST_REQUIRE( from_file && from_memory );
+    BOOST_CHECK_EQUAL( from_memory->label(), 3 );
+    BOOST_CHECK( from_memory->data() == from_file->data() );
+    BOOST_CHECK( ! load_image(image, std::vector<unsigned char>(), 3, options) );
+}
@@ -0,0 +1,65 @@
+/* Copyright 2017 Lieven Govaerts
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include "record_pool.hpp"
+#include "blocking_queue.hpp"
+
+BOOST_AUTO_TEST_CASE(pool_reuses_records)
+{
+    RecordPool pool;
+
+    shared_ptr<Record> first = pool.Get();
+    shared_ptr<Record> second = pool.Get();
+    BOOST_CHECK_EQUAL( pool.NrOfAllocations(), 2 );
+
+    first->key.assign(100, 'k');
+    first->datum.mutable_data()->assign(1000, 'd');
+    first->loaded = true;
+    Record* record = first.get();
+    pool.Put(std::move(first));
+    BOOST_CHECK( ! first );
+    BOOST_CHECK_EQUAL( pool.NrOfFreeRecords(), 1 );
+
+    /* The returned record comes back with its buffers. */
+    shared_ptr<Record> reused = pool.Get();
+    BOOST_CHECK_EQUAL( reused.get(), record );
+    BOOST_CHECK( ! reused->loaded );
+    BOOST_CHECK( reused->key.capacity() >= 100 );
+    BOOST_CHECK( reused->datum.data().capacity() >= 1000 );
+    BOOST_CHECK_EQUAL( pool.NrOfAllocations(), 2 );
+    BOOST_CHECK_EQUAL( pool.NrOfFreeRecords(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE(records_circulate_through_queue)
+{
+    RecordPool pool;
+    BlockingQueue<shared_ptr<Record> > queue(4, 1 << 20);
+
+    /* In steady state no new records are needed. */
+    for (int i = 0; i < 100; ++i) {
+        shared_ptr<Record> record = pool.Get();
+        record->key = "00000001_image.jpg";
+        BOOST_CHECK( queue.Push(std::move(record), 18) );
+        if (queue.Size() == 4) {
+            while (queue.Size() > 1) {
+                BOOST_CHECK( queue.Pop(record) );
+                pool.Put(std::move(record));
+            }
+        }
+    }
+    BOOST_CHECK( pool.NrOfAllocations() <= 4 );
+}